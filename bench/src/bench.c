@@ -0,0 +1,362 @@
+/**
+ * Benchmarks for the utilities
+ *
+ * By E.M. From
+ *
+ * Runs the host builds of the utilities over the files written by
+ * gencorpus and times them. Every case is run a number of times,
+ * with output thrown away, and the results are printed as CSV:
+ *
+ * case,tool,args,corpus,bytes,out_bytes,runs,read_calls,write_calls,
+ * best_ms,mean_ms,mb_per_s
+ *
+ * out_bytes is the size of the output, from one more run that is not
+ * timed, which for pack is the size of the packed file. That run is
+ * made with -S, read_calls and write_calls are the I/O calls the
+ * utility says it made.
+ * runs is how many times the case was timed, best_ms and mean_ms are
+ * the fastest and the average time of one run. mb_per_s is worked out
+ * from the fastest run, which is the one least disturbed by
+ * whatever else the computer was doing.
+ *
+ * Host build only.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Most arguments a case can have
+ *
+ */
+#define MAX_ARGS 6
+
+/**
+ * One benchmark
+ *
+ */
+struct bench_case
+{
+    //Name to report it under
+    char *name;
+
+    //Utility to run and its arguments, the corpus file is added last
+    char *tool;
+    char *args[MAX_ARGS];
+
+    //File in the corpus folder to run it on
+    char *corpus;
+};
+
+/**
+ * All benchmarks
+ *
+ */
+const struct bench_case cases[] = {
+    {"grep_short", "grep", {"ERROR"}, "log_short.txt"},
+    {"grep_medium", "grep", {"ERROR"}, "log_medium.txt"},
+    {"grep_long", "grep", {"ERROR"}, "log_long.txt"},
+    {"grep_rare", "grep", {"handler queue"}, "log_medium.txt"},
+    {"grep_i_short", "grep", {"-i", "error"}, "log_short.txt"},
+    {"grep_i_medium", "grep", {"-i", "error"}, "log_medium.txt"},
+    {"grep_i_long", "grep", {"-i", "error"}, "log_long.txt"},
+    {"grep_crlf", "grep", {"ERROR"}, "crlf.txt"},
+    {"grep_binary", "grep", {"sdcard"}, "binary.bin"},
+    {"grep_m1_medium", "grep", {"-m", "1", "ERROR"}, "log_medium.txt"},
+    {"grep_u_medium", "grep", {"-u", "ERROR"}, "log_medium.txt"},
+    {"grep_w_medium", "grep", {"-w", "a"}, "log_medium.txt"},
+    {"grep_a_binary", "grep", {"-a", "sdcard"}, "binary.bin"},
+    {"grep_j4_medium", "grep", {"-j", "4", "ERROR"}, "log_medium.txt"},
+    {"grep_i_j4_medium", "grep", {"-j", "4", "-i", "error"}, "log_medium.txt"},
+    {"wc_short", "wc", {NULL}, "log_short.txt"},
+    {"wc_medium", "wc", {NULL}, "log_medium.txt"},
+    {"wc_long", "wc", {NULL}, "log_long.txt"},
+    {"wc_l_medium", "wc", {"-l"}, "log_medium.txt"},
+    {"wc_crlf", "wc", {NULL}, "crlf.txt"},
+    {"wc_binary", "wc", {NULL}, "binary.bin"},
+    {"wc_j4_medium", "wc", {"-j", "4"}, "log_medium.txt"},
+    {"head_10", "head", {NULL}, "log_medium.txt"},
+    {"head_10000", "head", {"-n", "10000"}, "log_medium.txt"},
+    {"head_crlf", "head", {"-n", "10000"}, "crlf.txt"},
+    {"head_r", "head", {"-r", "50000,50010"}, "log_medium.txt"},
+    {"head_r_index", "head", {"-I", "-r", "50000,50010"}, "log_medium.txt"},
+    {"tail_10", "tail", {NULL}, "log_medium.txt"},
+    {"tail_10000", "tail", {"-n", "10000"}, "log_medium.txt"},
+    {"tail_all_short", "tail", {"-n", "10000000"}, "log_short.txt"},
+    {"tail_crlf", "tail", {"-n", "10000"}, "crlf.txt"},
+    {"tail_all_index", "tail", {"-I", "-n", "10000000"}, "log_short.txt"},
+    {"tail_r_10", "tail", {"-r", "-n", "10"}, "log_medium.txt"},
+    {"tail_r_all", "tail", {"-r"}, "log_medium.txt"},
+    {"strings_binary", "strings", {NULL}, "binary.bin"},
+    {"strings_t_binary", "strings", {"-t", "x"}, "binary.bin"},
+    {"strings_e_binary", "strings", {"-e", "sl"}, "binary.bin"},
+    {"strings_m_binary", "strings", {"-m", "sdcard"}, "binary.bin"},
+    {"strings_text", "strings", {NULL}, "log_medium.txt"},
+    {"pack_short", "pack", {"-c"}, "log_short.txt"},
+    {"pack_medium", "pack", {"-c"}, "log_medium.txt"},
+    {"pack_long", "pack", {"-c"}, "log_long.txt"},
+    {"pack_binary", "pack", {"-c"}, "binary.bin"},
+    {"unpack_medium", "pack", {"-c", "-d"}, "log_medium.lz4"},
+    {"grep_lz4_medium", "grep", {"ERROR"}, "log_medium.lz4"},
+    {"wc_lz4_medium", "wc", {NULL}, "log_medium.lz4"},
+    {"head_lz4_10000", "head", {"-n", "10000"}, "log_medium.lz4"},
+};
+
+const int case_count = sizeof (cases) / sizeof (cases[0]);
+
+/**
+ * Helper function to exit with an error message
+ *
+ */
+void exit_with_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Helper function to print a help message
+ *
+ */
+void show_usage (char *prog_name)
+{
+    printf ("Usage: %s [-h] [-r runs] [-b build] [-c case] corpus\n",
+            prog_name);
+    printf ("-h show this help message\n");
+    printf ("-r run every case runs times (default: 5)\n");
+    printf ("-b folder with the utilities (default: build)\n");
+    printf ("-c only run cases with names containing case\n");
+}
+
+/**
+ * Current time in seconds
+ *
+ */
+double now (void)
+{
+    struct timespec time;
+
+    clock_gettime (CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Run a case once, with output going to the file output
+ *
+ * If errors isn't NULL, what it prints to stderr goes to that file
+ *
+ * Returns how long it took in seconds
+ *
+ */
+double run_once (char *path, char **argv, char *output, char *errors)
+{
+    double start = now ();
+    pid_t child;
+    int status;
+
+    if ((child = fork ()) == -1)
+        exit_with_error ("Could not start utility");
+
+  /** In the child, run the utility */
+    if (child == 0)
+    {
+        int fd = open (output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        dup2 (fd, STDOUT_FILENO);
+
+        if (errors != NULL)
+        {
+            fd = open (errors, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2 (fd, STDERR_FILENO);
+        }
+
+        execv (path, argv);
+        _exit (127);
+    }
+
+  /** In the parent, wait for it */
+    if (waitpid (child, &status, 0) == -1 || !WIFEXITED (status)
+        || WEXITSTATUS (status) != 0)
+    {
+        fprintf (stderr, "%s failed\n", path);
+        exit (EXIT_FAILURE);
+    }
+
+    return now () - start;
+}
+
+/**
+ * Find a count in the statistics a utility printed with -S
+ *
+ * Returns -1 if it isn't there
+ *
+ */
+long read_stat (char *filename, const char *name)
+{
+    FILE *file;
+    char line[256];
+    long value = -1;
+
+    if ((file = fopen (filename, "r")) == NULL)
+        return -1;
+
+    while (fgets (line, sizeof (line), file) != NULL)
+        if (strncmp (line, name, strlen (name)) == 0)
+        {
+            value = atol (line + strlen (name));
+            break;
+        }
+
+    fclose (file);
+
+    return value;
+}
+
+/**
+ * Run a case a number of times and print the results
+ *
+ */
+void run_case (const struct bench_case *bench, char *build, char *corpus,
+               int runs)
+{
+    char path[1024];
+    char file[1024];
+    char output[1024];
+    char errors[1024];
+    char args[256] = "";
+    char *argv[MAX_ARGS + 3];
+    char *stats_argv[MAX_ARGS + 4];
+    int argc = 0;
+    struct stat info;
+
+    snprintf (path, sizeof (path), "%s/%s", build, bench->tool);
+    snprintf (file, sizeof (file), "%s/%s", corpus, bench->corpus);
+    snprintf (output, sizeof (output), "%s/bench.out", build);
+    snprintf (errors, sizeof (errors), "%s/bench.err", build);
+
+    if (stat (file, &info) != 0)
+        exit_with_error ("Corpus file missing, run gencorpus first");
+
+  /** Build the argument list */
+    argv[argc++] = bench->tool;
+
+    for (int i = 0; i < MAX_ARGS && bench->args[i] != NULL; i++)
+    {
+        argv[argc++] = bench->args[i];
+
+        //Arguments as one string for the report
+        if (i != 0)
+            strcat (args, " ");
+        strcat (args, bench->args[i]);
+    }
+
+    argv[argc++] = file;
+    argv[argc] = NULL;
+
+    //The same with -S in front
+    stats_argv[0] = argv[0];
+    stats_argv[1] = "-S";
+    memcpy (stats_argv + 2, argv + 1, argc * sizeof (char *));
+
+  /** Run it */
+    double best = 0;
+    double total = 0;
+
+    for (int i = 0; i < runs; i++)
+    {
+        double time = run_once (path, argv, "/dev/null", NULL);
+
+        if (i == 0 || time < best)
+            best = time;
+
+        total += time;
+    }
+
+  /** Once more to see how much it writes, and how */
+    struct stat written;
+
+    run_once (path, stats_argv, output, errors);
+
+    if (stat (output, &written) != 0)
+        exit_with_error ("Could not find the output");
+
+    long read_calls = read_stat (errors, "read calls");
+    long write_calls = read_stat (errors, "write calls");
+
+    unlink (output);
+    unlink (errors);
+
+  /** Report */
+    printf ("%s,%s,\"%s\",%s,%ld,%ld,%d,%ld,%ld,%.3f,%.3f,%.2f\n",
+            bench->name, bench->tool, args, bench->corpus,
+            (long) info.st_size, (long) written.st_size, runs, read_calls,
+            write_calls, best * 1000, total / runs * 1000,
+            info.st_size / best / (1024 * 1024));
+    fflush (stdout);
+}
+
+int main (int argc, char *argv[])
+{
+    int runs = 5;
+    char *build = "build";
+    char *only = NULL;
+    char *corpus = NULL;
+
+  /** Argument processing */
+    for (int i = 1; i != argc; i++)
+    {
+        if (strcmp (argv[i], "-h") == 0)
+        {
+            show_usage (argv[0]);
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp (argv[i], "-r") == 0 && i + 1 != argc)
+        {
+            if ((runs = atoi (argv[++i])) <= 0)
+                exit_with_error ("The number of runs must be positive");
+        }
+        else if (strcmp (argv[i], "-b") == 0 && i + 1 != argc)
+        {
+            build = argv[++i];
+        }
+        else if (strcmp (argv[i], "-c") == 0 && i + 1 != argc)
+        {
+            only = argv[++i];
+        }
+        else if (!corpus)
+        {
+            corpus = argv[i];
+        }
+        else
+        {
+            show_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (corpus == NULL)
+    {
+        show_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+  /** Run the cases */
+    printf ("case,tool,args,corpus,bytes,out_bytes,runs,read_calls,"
+            "write_calls,best_ms,mean_ms,mb_per_s\n");
+
+    for (int i = 0; i < case_count; i++)
+        if (only == NULL || strstr (cases[i].name, only) != NULL)
+            run_case (&cases[i], build, corpus, runs);
+
+    return EXIT_SUCCESS;
+}
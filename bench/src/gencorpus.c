@@ -0,0 +1,246 @@
+/**
+ * Corpus generator for the benchmarks
+ *
+ * By E.M. From
+ *
+ * Writes the files the benchmarks run on into a folder. The files are
+ * made from a fixed seed, so every run (and every computer) gets
+ * exactly the same files and the numbers can be compared.
+ *
+ * Files written:
+ * log_short.txt   log with short lines (about 20 characters)
+ * log_medium.txt  log with medium lines (about 80 characters)
+ * log_long.txt    log with long lines (about 400 characters)
+ * crlf.txt        the medium log with dos style \r\n line endings
+ *                 and no newline at the very end
+ * binary.bin      random bytes with strings (ASCII and UTF-16LE) in it
+ *
+ * Host build only.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Default size of each file
+ *
+ */
+#define DEFAULT_SIZE (4L * 1024 * 1024)
+
+/**
+ * Random numbers
+ *
+ * A small xorshift generator is used instead of rand(), which
+ * gives different numbers with different C libraries
+ */
+unsigned long long random_state;
+
+unsigned long next_random (void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+
+    return (unsigned long) (random_state >> 16);
+}
+
+/**
+ * Start over from the seed, so each file comes out the same
+ * whatever order they are written in
+ *
+ */
+void seed_random (unsigned long long seed)
+{
+    random_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+/**
+ * Words log messages are made from
+ *
+ */
+const char *words[] = {
+    "connection", "timeout", "request", "sector", "buffer", "device",
+    "file", "opened", "closed", "read", "write", "retry", "user", "vdp",
+    "keyboard", "mos", "sdcard", "block", "cache", "flush", "the", "a",
+    "to", "from", "with", "after", "ms", "bytes", "handler", "queue",
+    "Error", "error", "ERROR", "warning", "ok", "done", "started"
+};
+
+const int word_count = sizeof (words) / sizeof (words[0]);
+
+/**
+ * Levels, one in 16 lines is an ERROR line
+ *
+ */
+const char *levels[] = {
+    "INFO ", "INFO ", "INFO ", "INFO ", "INFO ", "INFO ", "INFO ", "INFO ",
+    "DEBUG", "DEBUG", "DEBUG", "DEBUG", "WARN ", "WARN ", "NOTE ", "ERROR"
+};
+
+/**
+ * Helper function to exit with an error message
+ *
+ */
+void exit_with_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Open path/name for writing
+ *
+ */
+FILE *open_output (char *path, char *name)
+{
+    char filename[1024];
+    FILE *file;
+
+    snprintf (filename, sizeof (filename), "%s/%s", path, name);
+
+    if ((file = fopen (filename, "wb")) == NULL)
+        exit_with_error ("Error opening output file");
+
+    return file;
+}
+
+/**
+ * Write a log of about size bytes with lines about line_length long
+ *
+ */
+void write_log (FILE * file, long size, int line_length, char *line_end,
+                int final_newline)
+{
+    long written = 0;
+    long line_number = 0;
+
+    while (written < size)
+    {
+        char line[4096];
+        int length;
+
+      /** Time stamp, level and module */
+        length = sprintf (line, "%02ld:%02ld:%02ld %s",
+                          line_number / 3600 % 24, line_number / 60 % 60,
+                          line_number % 60, levels[next_random () % 16]);
+
+      /** Words until the line is long enough */
+        // Line lengths vary between half and one and a half line_length
+        int wanted = line_length / 2 + next_random () % (line_length + 1);
+
+        while (length < wanted)
+            length += sprintf (line + length, " %s",
+                               words[next_random () % word_count]);
+
+      /** Line ending */
+        // No line ending on the very last line, if asked for
+        if (written + length < size || final_newline)
+            length += sprintf (line + length, "%s", line_end);
+
+        fwrite (line, 1, length, file);
+        written += length;
+        line_number++;
+    }
+}
+
+/**
+ * Write about size bytes of random binary data with strings in it
+ *
+ */
+void write_binary (FILE * file, long size)
+{
+    long written = 0;
+
+    while (written < size)
+    {
+        int kind = next_random () % 8;
+
+      /** Mostly random bytes */
+        if (kind < 5)
+        {
+            int length = next_random () % 256;
+
+            for (int i = 0; i < length; i++)
+                putc (next_random () & 0xFF, file);
+
+            written += length;
+        }
+
+      /** ASCII string, ended by a NUL */
+        else if (kind < 7)
+        {
+            const char *word = words[next_random () % word_count];
+            int repeat = 1 + next_random () % 4;
+
+            for (int i = 0; i < repeat; i++)
+                written += fprintf (file, "%s ", word);
+
+            putc ('\0', file);
+            written++;
+        }
+
+      /** UTF-16LE string */
+        else
+        {
+            const char *word = words[next_random () % word_count];
+
+            for (const char *ch = word; *ch; ch++)
+            {
+                putc (*ch, file);
+                putc ('\0', file);
+                written += 2;
+            }
+
+            putc ('\0', file);
+            putc ('\0', file);
+            written += 2;
+        }
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    long size = DEFAULT_SIZE;
+    FILE *file;
+
+    if (argc != 2 && argc != 3)
+    {
+        printf ("Usage: %s folder [size]\n", argv[0]);
+        printf ("Writes the benchmark files, each about size bytes\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 3 && (size = atol (argv[2])) <= 0)
+        exit_with_error ("The size must be positive");
+
+  /** The logs */
+    seed_random (1);
+    file = open_output (argv[1], "log_short.txt");
+    write_log (file, size, 20, "\n", 1);
+    fclose (file);
+
+    seed_random (2);
+    file = open_output (argv[1], "log_medium.txt");
+    write_log (file, size, 80, "\n", 1);
+    fclose (file);
+
+    seed_random (3);
+    file = open_output (argv[1], "log_long.txt");
+    write_log (file, size, 400, "\n", 1);
+    fclose (file);
+
+    seed_random (2);
+    file = open_output (argv[1], "crlf.txt");
+    write_log (file, size, 80, "\r\n", 0);
+    fclose (file);
+
+  /** Binary with strings */
+    seed_random (4);
+    file = open_output (argv[1], "binary.bin");
+    write_binary (file, size);
+    fclose (file);
+
+    return EXIT_SUCCESS;
+}
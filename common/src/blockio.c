@@ -0,0 +1,615 @@
+/**
+ * Block I/O for Agon Light
+ *
+ * Buffered reading and writing shared by the utilities
+ *
+ * By E.M. From
+ *
+ * See blockio.h for how to use it
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockio.h"
+#include "lz4read.h"
+#include "stats.h"
+
+#ifdef BLOCKIO_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * Everything the reader needs to keep track of
+ *
+ */
+struct block_reader_s
+{
+    FILE *file;
+
+    //The buffer and its size
+    char *buf;
+    size_t size;
+
+    //Data in the buffer not handed out yet
+    char *data;
+    size_t length;
+
+    //Have we read the last of the file?
+    bool eof;
+
+    //Reading backwards?
+    bool backward;
+
+    //Backwards only, file offset of the last block returned
+    long position;
+
+    //Decompressor, for LZ4 files
+    lz4_reader lz4;
+
+#ifdef BLOCKIO_MMAP
+    //The whole file, if it could be mapped
+    char *map;
+    size_t map_length;
+#endif
+};
+
+/**
+ * Everything the writer needs to keep track of
+ *
+ */
+struct block_writer_s
+{
+    //Where the data goes, a file or a sink
+    FILE *file;
+    block_sink sink;
+    int flags;
+
+    //The buffer, its size and how much of it is used
+    char *buf;
+    size_t size;
+    size_t length;
+
+    //With BLOCK_WRITER_CRLF, the last byte written (by any call)
+    char last;
+};
+
+/**
+ * Helper function to exit with an error message
+ *
+ */
+static void blockio_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Round a buffer size up to a whole number of sectors
+ *
+ */
+static size_t sector_size (size_t size)
+{
+    if (size == 0)
+        size = BLOCKIO_SIZE;
+
+    return (size + BLOCKIO_SECTOR - 1) / BLOCKIO_SECTOR * BLOCKIO_SECTOR;
+}
+
+/**
+ * Fill the buffer with up to count bytes after what is already in it
+ *
+ * Returns the number of bytes read
+ *
+ */
+static size_t block_reader_fill (block_reader reader, size_t count)
+{
+    size_t got;
+
+  /** Compressed files are read by the decompressor */
+    if (reader->lz4 != NULL)
+        got = lz4_reader_read (reader->lz4, reader->data + reader->length,
+                               count);
+    else
+    {
+        got = fread (reader->data + reader->length, 1, count, reader->file);
+
+        stats.read_calls++;
+        stats.bytes_read += got;
+
+        if (got != count && ferror (reader->file))
+            blockio_error ("Error reading from file");
+    }
+
+  /** Short read means end of file */
+    if (got != count)
+        reader->eof = true;
+
+    reader->length += got;
+
+    return got;
+}
+
+#ifdef BLOCKIO_MMAP
+/**
+ * Try to map the whole file into memory
+ *
+ * The file is then all in the buffer, from where it is at now to the
+ * end, and the rest of the reader works on it as it is. Only regular
+ * files can be mapped, not pipes or terminals.
+ *
+ * Returns true if it worked
+ *
+ */
+static bool block_reader_map (block_reader reader)
+{
+    struct stat status;
+    long offset;
+    void *map;
+
+    reader->map = NULL;
+
+    if (fstat (fileno (reader->file), &status) != 0
+        || !S_ISREG (status.st_mode) || status.st_size == 0
+        || (offset = ftell (reader->file)) == -1
+        || offset > status.st_size)
+        return false;
+
+    map = mmap (NULL, status.st_size, PROT_READ, MAP_PRIVATE,
+                fileno (reader->file), 0);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    //Mostly read front to back
+    madvise (map, status.st_size, MADV_SEQUENTIAL);
+
+    reader->map = map;
+    reader->map_length = status.st_size;
+
+  /** Everything is "read" */
+    reader->buf = NULL;
+    reader->data = reader->map + offset;
+    reader->length = reader->map_length - offset;
+    reader->eof = true;
+
+    stats.read_calls++;
+    stats.bytes_read += reader->length;
+
+    return true;
+}
+#endif
+
+/**
+ * Create a reader, decompressing LZ4 files if decompress is set
+ *
+ */
+static block_reader block_reader_start (FILE * file, size_t size,
+                                        bool decompress)
+{
+    block_reader reader;
+
+  /** Allocate space */
+    if ((reader = malloc (sizeof (struct block_reader_s))) == NULL)
+        blockio_error ("Could not allocate memory");
+
+    stats.allocations++;
+
+  /** Nothing read yet */
+    reader->file = file;
+    reader->size = sector_size (size);
+    reader->backward = false;
+    reader->position = 0;
+
+  /** Compressed? */
+    reader->lz4 = NULL;
+
+#ifndef BLOCKIO_NO_LZ4
+    if (decompress && lz4_detect (file))
+        reader->lz4 = lz4_reader_open (file);
+#else
+    (void) decompress;
+#endif
+
+#ifdef BLOCKIO_MMAP
+    reader->map = NULL;
+
+    if (reader->lz4 == NULL && block_reader_map (reader))
+        return reader;
+#endif
+
+    if ((reader->buf = malloc (reader->size)) == NULL)
+        blockio_error ("Could not allocate memory");
+
+    stats.allocations++;
+
+    reader->data = reader->buf;
+    reader->length = 0;
+    reader->eof = false;
+
+    return reader;
+}
+
+block_reader block_reader_open (FILE * file, size_t size)
+{
+    return block_reader_start (file, size, true);
+}
+
+block_reader block_reader_open_raw (FILE * file, size_t size)
+{
+    return block_reader_start (file, size, false);
+}
+
+const char *block_reader_error (block_reader reader)
+{
+    return reader->lz4 != NULL ? lz4_reader_error (reader->lz4) : NULL;
+}
+
+void block_reader_close (block_reader reader)
+{
+#ifdef BLOCKIO_MMAP
+    if (reader->map != NULL)
+        munmap (reader->map, reader->map_length);
+#endif
+
+    if (reader->lz4 != NULL)
+        lz4_reader_close (reader->lz4);
+
+    free (reader->buf);
+    free (reader);
+}
+
+size_t block_reader_next (block_reader reader, char **block)
+{
+    size_t length;
+
+  /** Anything left over from reading lines? */
+    // If not, fill the whole buffer
+    if (reader->length == 0)
+    {
+        if (reader->eof)
+            return 0;
+
+        reader->data = reader->buf;
+        block_reader_fill (reader, reader->size);
+    }
+
+  /** Hand out everything we have */
+    *block = reader->data;
+    length = reader->length;
+
+    reader->data += length;
+    reader->length = 0;
+
+    return length;
+}
+
+size_t block_reader_peek (block_reader reader, char **block)
+{
+
+  /** Nothing left over? Read a block */
+    if (reader->length == 0 && !reader->eof)
+    {
+        reader->data = reader->buf;
+        block_reader_fill (reader, reader->size);
+    }
+
+  /** Show it, but leave it where it is */
+    *block = reader->data;
+
+    return reader->length < reader->size ? reader->length : reader->size;
+}
+
+size_t block_reader_line (block_reader reader, char **line, bool *complete)
+{
+    //How much of the data has been searched for a newline
+    size_t searched = 0;
+
+    for (;;)
+    {
+
+      /** Look for the end of the line in what we have */
+        char *newline = memchr (reader->data + searched, '\n',
+                                reader->length - searched);
+
+        //Found a complete line, or the last line in the file
+        if (newline != NULL || (reader->eof && reader->length != 0))
+        {
+            size_t length = newline != NULL ?
+                (size_t) (newline - reader->data + 1) : reader->length;
+
+            *line = reader->data;
+            *complete = true;
+
+            reader->data += length;
+            reader->length -= length;
+
+            return length;
+        }
+
+        //Nothing left at all
+        if (reader->eof)
+            return 0;
+
+      /** Make room for more */
+        //Move the start of the line to the start of the buffer
+        // It is only the start of one line, so this is not much to copy
+        if (reader->data != reader->buf)
+        {
+            memmove (reader->buf, reader->data, reader->length);
+            reader->data = reader->buf;
+        }
+
+        searched = reader->length;
+
+        //Only read whole sectors, so the reads keep lining up
+        // with the sectors on the sdcard
+        size_t room = (reader->size - reader->length)
+            / BLOCKIO_SECTOR * BLOCKIO_SECTOR;
+
+        //Line too long for the buffer? Hand out what we have of it
+        if (room == 0)
+        {
+            size_t length = reader->length;
+
+            *line = reader->data;
+            *complete = false;
+
+            reader->data += length;
+            reader->length = 0;
+
+            return length;
+        }
+
+        block_reader_fill (reader, room);
+    }
+}
+
+size_t block_reader_prev (block_reader reader, char **block)
+{
+
+  /** Compressed files can only be read from the start */
+    if (reader->lz4 != NULL)
+        blockio_error ("Compressed files can't be read backwards");
+
+#ifdef BLOCKIO_MMAP
+  /** Mapped? Then the whole file is one block */
+    if (reader->map != NULL)
+    {
+        if (reader->backward)
+            return 0;
+
+        reader->backward = true;
+        *block = reader->map;
+
+        return reader->map_length;
+    }
+#endif
+
+  /** First time? Start at the end of the file */
+    if (!reader->backward)
+    {
+        if (0 != fseek (reader->file, 0L, SEEK_END))
+            blockio_error ("Filesystem error");
+
+        if ((reader->position = ftell (reader->file)) == -1)
+            blockio_error ("Filesystem error");
+
+        stats.seeks++;
+
+        reader->backward = true;
+    }
+
+  /** At the start of the file? */
+    if (reader->position == 0)
+        return 0;
+
+  /** Find the block before the last one */
+    // Blocks start on a multiple of the buffer size, so the
+    // first block read (at the end of the file) may be shorter
+    long start = (reader->position - 1) / reader->size * reader->size;
+    size_t length = reader->position - start;
+
+  /** Read it */
+    if (0 != fseek (reader->file, start, SEEK_SET))
+        blockio_error ("Filesystem error");
+
+    if (1 != fread (reader->buf, length, 1, reader->file))
+        blockio_error ("Error reading from file");
+
+    stats.seeks++;
+    stats.read_calls++;
+    stats.bytes_read += length;
+
+    reader->position = start;
+
+    *block = reader->buf;
+
+    return length;
+}
+
+bool block_reader_at_start (block_reader reader)
+{
+#ifdef BLOCKIO_MMAP
+  /** Mapped? Then the only block is the whole file */
+    if (reader->map != NULL)
+        return reader->backward;
+#endif
+
+    return reader->backward && reader->position == 0;
+}
+
+block_writer block_writer_open (FILE * file, size_t size)
+{
+    block_writer writer;
+
+  /** Allocate space */
+    if ((writer = malloc (sizeof (struct block_writer_s))) == NULL)
+        blockio_error ("Could not allocate memory");
+
+    writer->size = sector_size (size);
+
+    if ((writer->buf = malloc (writer->size)) == NULL)
+        blockio_error ("Could not allocate memory");
+
+    stats.allocations += 2;
+
+    writer->file = file;
+    writer->sink = NULL;
+    writer->flags = 0;
+    writer->length = 0;
+    writer->last = '\0';
+
+    return writer;
+}
+
+block_writer block_writer_open_sink (block_sink sink, size_t size,
+                                     int flags)
+{
+    block_writer writer = block_writer_open (NULL, size);
+
+    writer->sink = sink;
+    writer->flags = flags;
+
+    return writer;
+}
+
+/**
+ * Hand data to the file or the sink
+ *
+ */
+static void block_writer_send (block_writer writer, const char *data,
+                               size_t length)
+{
+    if (writer->sink != NULL)
+        writer->sink (data, length);
+    else if (1 != fwrite (data, length, 1, writer->file))
+        blockio_error ("Error writing to file");
+
+    stats.write_calls++;
+    stats.bytes_written += length;
+}
+
+void block_writer_flush (block_writer writer)
+{
+    if (writer->length == 0)
+        return;
+
+    block_writer_send (writer, writer->buf, writer->length);
+
+    writer->length = 0;
+}
+
+/**
+ * Write length bytes from data, with every \n as \r\n
+ *
+ * Everything up to the next \n is copied in one go. A \n that
+ * already comes after a \r, in this write or the one before,
+ * is left as it is.
+ *
+ */
+static void block_writer_write_crlf (block_writer writer, const char *data,
+                                     size_t length)
+{
+    const char *end = data + length;
+
+    while (data != end)
+    {
+
+    /** Copy up to the next newline, or as much as fits */
+        const char *newline = memchr (data, '\n', end - data);
+        size_t part = (newline != NULL ? newline : end) - data;
+        size_t room = writer->size - writer->length;
+
+        if (part > room)
+            part = room;
+
+        memcpy (writer->buf + writer->length, data, part);
+        writer->length += part;
+        data += part;
+
+        if (part != 0)
+            writer->last = data[-1];
+
+        //Full? Then go on with an empty buffer
+        if (writer->length == writer->size)
+        {
+            block_writer_flush (writer);
+            continue;
+        }
+
+    /** At a newline, write it as two characters */
+        if (data != end)
+        {
+            if (writer->size - writer->length < 2)
+                block_writer_flush (writer);
+
+            if (writer->last != '\r')
+                writer->buf[writer->length++] = '\r';
+
+            writer->buf[writer->length++] = '\n';
+            writer->last = '\n';
+            data++;
+        }
+    }
+}
+
+/**
+ * Write length bytes from data as they are
+ *
+ */
+static void block_writer_write_plain (block_writer writer, const char *data,
+                                      size_t length)
+{
+
+  /** Does it fit in the buffer? */
+    if (writer->length + length <= writer->size)
+    {
+        memcpy (writer->buf + writer->length, data, length);
+        writer->length += length;
+        return;
+    }
+
+  /** Nope, write what we have */
+    block_writer_flush (writer);
+
+  /** Large writes go straight to the file or sink */
+    // There is no point in copying them to the buffer first
+    if (length >= writer->size)
+    {
+        block_writer_send (writer, data, length);
+        return;
+    }
+
+    memcpy (writer->buf, data, length);
+    writer->length = length;
+}
+
+void block_writer_write (block_writer writer, const char *data,
+                         size_t length)
+{
+
+  /** Newlines to translate? */
+    if (writer->flags & BLOCK_WRITER_CRLF)
+        block_writer_write_crlf (writer, data, length);
+    else
+        block_writer_write_plain (writer, data, length);
+
+  /** Unbuffered, everything goes out at once */
+    if (writer->flags & BLOCK_WRITER_UNBUFFERED)
+        block_writer_flush (writer);
+}
+
+void block_writer_puts (block_writer writer, const char *string)
+{
+    block_writer_write (writer, string, strlen (string));
+}
+
+void block_writer_close (block_writer writer)
+{
+    block_writer_flush (writer);
+    free (writer->buf);
+    free (writer);
+}
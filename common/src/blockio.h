@@ -0,0 +1,213 @@
+/**
+ * Block I/O for Agon Light
+ *
+ * Buffered reading and writing shared by the utilities
+ *
+ * By E.M. From
+ *
+ * Reading from the sdcard is a lot faster in large blocks than
+ * a byte or a line at a time. The block reader reads a file in
+ * blocks that are a multiple of the sector size and lets the
+ * utilities look at the data right where it was read to,
+ * without copying it anywhere.
+ *
+ * The reader can go through a file in three ways:
+ * - Forward, one block at a time (block_reader_next)
+ * - Forward, one line at a time (block_reader_line)
+ * - Backward, one block at a time from the end (block_reader_prev)
+ *
+ * The block writer collects small writes into one large write.
+ * Instead of a file it can hand its data to a function, a sink,
+ * and turn \n into \r\n on the way (for the VDP console, see
+ * output.h).
+ *
+ * Files compressed with lz4 are decompressed while they are read,
+ * see lz4read.h. block_reader_open_raw() reads them as they are,
+ * define BLOCKIO_NO_LZ4 to always do so.
+ *
+ * In the host build, files are mapped into memory if they can be,
+ * instead of being read into the buffer. The whole file is then
+ * one block and lines can be any length. Define BLOCKIO_NO_MMAP
+ * to always read.
+ *
+ * Errors are fatal, a message is printed and the program exits.
+ * Except for compressed files that can't be read, those end early
+ * and block_reader_error() says why.
+ *
+ */
+
+#ifndef BLOCKIO_H
+#define BLOCKIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Size of a sector on the sdcard
+ *
+ * Buffer sizes are always a multiple of this
+ */
+#define BLOCKIO_SECTOR 512
+
+/**
+ * Default buffer size
+ *
+ * Used when a size of 0 is asked for.
+ * Can be tuned by the makefile, it is rounded up to a
+ * multiple of BLOCKIO_SECTOR
+ */
+#ifndef BLOCKIO_SIZE
+#define BLOCKIO_SIZE 4096
+#endif
+
+/**
+ * Map files into memory?
+ *
+ * Host build only, the Agon has no mmap()
+ */
+#if defined(HOST_BUILD) && !defined(BLOCKIO_NO_MMAP)
+#define BLOCKIO_MMAP
+#endif
+
+/**
+ * Reader and writer
+ *
+ * What is inside is private to blockio.c
+ */
+typedef struct block_reader_s *block_reader;
+typedef struct block_writer_s *block_writer;
+
+/**
+ * Where a writer's data goes, instead of a file
+ *
+ * Called with the buffer when it is full, flushed or closed
+ */
+typedef void (*block_sink) (const char *data, size_t length);
+
+/**
+ * Options for block_writer_open_sink()
+ *
+ * BLOCK_WRITER_CRLF writes every \n as \r\n, unless a \r comes before it
+ * BLOCK_WRITER_UNBUFFERED flushes after every write
+ */
+#define BLOCK_WRITER_CRLF 1
+#define BLOCK_WRITER_UNBUFFERED 2
+
+/**
+ * Create a reader for file with a buffer of size bytes
+ *
+ * size is rounded up to a multiple of BLOCKIO_SECTOR,
+ * 0 means BLOCKIO_SIZE
+ */
+block_reader block_reader_open (FILE * file, size_t size);
+
+/**
+ * Create a reader that doesn't decompress
+ *
+ * The same as block_reader_open(), but LZ4 files are read as they
+ * are, for looking at the bytes of the file itself
+ */
+block_reader block_reader_open_raw (FILE * file, size_t size);
+
+/**
+ * Why the file ended early, NULL if it didn't
+ *
+ * Only LZ4 files end early, at a frame that is damaged or can't be
+ * read (see lz4_reader_error). The message is a constant.
+ */
+const char *block_reader_error (block_reader reader);
+
+/**
+ * Free a reader
+ *
+ * The file is not closed
+ */
+void block_reader_close (block_reader reader);
+
+/**
+ * Get the next block of the file
+ *
+ * Points block at the data and returns its length, 0 at end of file
+ */
+size_t block_reader_next (block_reader reader, char **block);
+
+/**
+ * Look at the start of what is still to be read, without reading it
+ *
+ * Points block at the data and returns its length, at most the buffer
+ * size, 0 at end of file. The next call to block_reader_next() or
+ * block_reader_line() starts at the same place.
+ */
+size_t block_reader_peek (block_reader reader, char **block);
+
+/**
+ * Get the next line of the file
+ *
+ * Points line at the line and returns its length, including the '\n',
+ * 0 at end of file. The line is NOT '\0' terminated.
+ *
+ * A line too long for the buffer is returned in pieces, complete is
+ * set to false for all pieces but the last one.
+ */
+size_t block_reader_line (block_reader reader, char **line, bool *complete);
+
+/**
+ * Get the block before the last one returned, starting at the end of the file
+ *
+ * Points block at the data and returns its length, 0 at start of file
+ * All blocks but the last one in the file start and end on a buffer
+ * size boundary.
+ */
+size_t block_reader_prev (block_reader reader, char **block);
+
+/**
+ * Is the last block returned by block_reader_prev() the start of the file?
+ *
+ * There is nothing before it to read, so the block stays where it is,
+ * the buffer isn't used for another one
+ */
+bool block_reader_at_start (block_reader reader);
+
+/**
+ * Create a writer for file with a buffer of size bytes
+ *
+ * size works as for block_reader_open()
+ */
+block_writer block_writer_open (FILE * file, size_t size);
+
+/**
+ * Create a writer that hands its data to sink
+ *
+ * flags are any of the BLOCK_WRITER_ options above, or'ed together
+ */
+block_writer block_writer_open_sink (block_sink sink, size_t size,
+                                     int flags);
+
+/**
+ * Write length bytes from data
+ *
+ */
+void block_writer_write (block_writer writer, const char *data,
+                         size_t length);
+
+/**
+ * Write a string
+ *
+ */
+void block_writer_puts (block_writer writer, const char *string);
+
+/**
+ * Write everything in the buffer to the file
+ *
+ */
+void block_writer_flush (block_writer writer);
+
+/**
+ * Flush and free a writer
+ *
+ * The file is not closed
+ */
+void block_writer_close (block_writer writer);
+
+#endif
@@ -0,0 +1,380 @@
+/**
+ * Line index for Agon Light
+ *
+ * Jumping to line N of a large file without reading all lines before it
+ *
+ * By E.M. From
+ *
+ * See lineidx.h for how to use it and what the index file looks like
+ *
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockio.h"
+#include "lineidx.h"
+#include "lz4read.h"
+#include "stats.h"
+
+/**
+ * Size of the start of the index file, before the offsets
+ *
+ */
+#define LINEIDX_HEADER 20
+
+/**
+ * Bytes at the start and at the end of the indexed part that
+ * go into its fingerprint
+ *
+ */
+#define LINEIDX_FINGERPRINT 256
+
+/**
+ * Everything the index needs to keep track of
+ *
+ */
+struct line_index_s
+{
+    //The index file, kept open for line_index_seek()
+    FILE *index_file;
+
+    //From the start of the index file
+    unsigned long stride;
+    unsigned long indexed_size;
+    unsigned long line_count;
+    unsigned long fingerprint;
+
+    //Is there a last line without a '\n' after the indexed part?
+    bool partial_line;
+};
+
+/**
+ * Store a 32-bit number, little endian
+ *
+ */
+static void put_number (unsigned char *bytes, unsigned long value)
+{
+    for (int i = 0; i < 4; i++)
+        bytes[i] = (value >> (8 * i)) & 0xFF;
+}
+
+/**
+ * Get a 32-bit number, little endian
+ *
+ */
+static unsigned long get_number (const unsigned char *bytes)
+{
+    unsigned long value = 0;
+
+    for (int i = 3; i >= 0; i--)
+        value = (value << 8) | bytes[i];
+
+    return value;
+}
+
+/**
+ * Read the start of the index file
+ *
+ * Returns false if it is not a line index with our stride
+ *
+ */
+static bool read_header (line_index index)
+{
+    unsigned char header[LINEIDX_HEADER];
+
+    if (0 != fseek (index->index_file, 0L, SEEK_SET)
+        || 1 != fread (header, LINEIDX_HEADER, 1, index->index_file))
+        return false;
+
+    stats.seeks++;
+    stats.read_calls++;
+
+    if (memcmp (header, "LID2", 4) != 0)
+        return false;
+
+    index->stride = get_number (header + 4);
+    index->indexed_size = get_number (header + 8);
+    index->line_count = get_number (header + 12);
+    index->fingerprint = get_number (header + 16);
+
+    return index->stride == LINEIDX_STRIDE;
+}
+
+/**
+ * Write the start of the index file
+ *
+ * Returns false if it could not be written
+ *
+ */
+static bool write_header (line_index index)
+{
+    unsigned char header[LINEIDX_HEADER];
+
+    memcpy (header, "LID2", 4);
+    put_number (header + 4, index->stride);
+    put_number (header + 8, index->indexed_size);
+    put_number (header + 12, index->line_count);
+    put_number (header + 16, index->fingerprint);
+
+    stats.seeks++;
+    stats.write_calls++;
+
+    return 0 == fseek (index->index_file, 0L, SEEK_SET)
+        && 1 == fwrite (header, LINEIDX_HEADER, 1, index->index_file)
+        && 0 == fflush (index->index_file);
+}
+
+/**
+ * Fingerprint of the indexed part of file
+ *
+ * A checksum (32-bit FNV-1a) of its first and its last
+ * LINEIDX_FINGERPRINT bytes, which can be the same bytes in a short
+ * file. Two reads, however large the file is.
+ *
+ * Returns false if the file can't be read
+ *
+ */
+static bool fingerprint (line_index index, FILE * file,
+                         unsigned long *result)
+{
+    unsigned char bytes[LINEIDX_FINGERPRINT];
+    unsigned long hash = 2166136261UL;
+    size_t length = LINEIDX_FINGERPRINT;
+
+    if (index->indexed_size < length)
+        length = index->indexed_size;
+
+  /** The start, then the end */
+    unsigned long starts[2] = { 0, index->indexed_size - length };
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (0 != fseek (file, starts[i], SEEK_SET)
+            || length != fread (bytes, 1, length, file))
+            return false;
+
+        stats.seeks++;
+        stats.read_calls++;
+
+        for (size_t j = 0; j < length; j++)
+            hash = ((hash ^ bytes[j]) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    *result = hash;
+
+    return true;
+}
+
+/**
+ * Is the index still about this file?
+ *
+ * The file must be at least as long as the indexed part, and the
+ * indexed part must still have the same fingerprint. Anything else
+ * means the file was replaced rather than appended to, even when
+ * the new file is longer and has a '\n' where the index stopped.
+ *
+ */
+static bool index_matches (line_index index, FILE * file, long size)
+{
+    unsigned long now;
+
+    if ((unsigned long) size < index->indexed_size)
+        return false;
+
+    return fingerprint (index, file, &now) && now == index->fingerprint;
+}
+
+/**
+ * Index the part of file after the indexed size
+ *
+ * Returns false if the index file could not be written
+ *
+ */
+static bool extend_index (line_index index, FILE * file)
+{
+    block_reader reader;
+    char *block;
+    size_t length;
+
+    //Offset in the file of the block being looked at
+    unsigned long offset = index->indexed_size;
+
+    //Room for one offset in the index file
+    unsigned char bytes[4];
+
+  /** Start where the index stops */
+    // New offsets go after the ones there are
+    if (0 != fseek (file, index->indexed_size, SEEK_SET)
+        || 0 != fseek (index->index_file, LINEIDX_HEADER
+                       + 4 * (index->line_count / index->stride), SEEK_SET))
+        return false;
+
+    stats.seeks += 2;
+
+    reader = block_reader_open (file, 0);
+
+  /** Go through the rest of the file, looking for '\n' */
+    while ((length = block_reader_next (reader, &block)) != 0)
+    {
+        char *here = block;
+        char *newline;
+
+        while ((newline = memchr (here, '\n', block + length - here)) != NULL)
+        {
+            here = newline + 1;
+
+            index->line_count++;
+            index->indexed_size = offset + (here - block);
+
+          /** Every stride lines, write down where the next one starts */
+            if (index->line_count % index->stride == 0)
+            {
+                put_number (bytes, index->indexed_size);
+
+                if (1 != fwrite (bytes, 4, 1, index->index_file))
+                {
+                    block_reader_close (reader);
+                    return false;
+                }
+
+                stats.write_calls++;
+            }
+        }
+
+        offset += length;
+    }
+
+    block_reader_close (reader);
+
+  /** The indexed part ends somewhere else now */
+    return fingerprint (index, file, &index->fingerprint)
+        && write_header (index);
+}
+
+line_index line_index_open (FILE * file, const char *filename)
+{
+    line_index index;
+    char *index_name;
+    long size;
+
+#ifndef BLOCKIO_NO_LZ4
+  /** Offsets in a compressed file can't be seeked to */
+    if (lz4_detect (file))
+        return NULL;
+#endif
+
+  /** How long is the file? */
+    // The index holds 32-bit offsets
+    if (0 != fseek (file, 0L, SEEK_END) || (size = ftell (file)) == -1
+        || (unsigned long) size > 0xFFFFFFFFUL)
+        return NULL;
+
+    stats.seeks++;
+
+  /** Allocate space */
+    if ((index = malloc (sizeof (struct line_index_s))) == NULL)
+        return NULL;
+
+    if ((index_name = malloc (strlen (filename) + 5)) == NULL)
+    {
+        free (index);
+        return NULL;
+    }
+
+    stats.allocations += 2;
+
+    strcpy (index_name, filename);
+    strcat (index_name, ".idx");
+
+  /** Open the index, or start a new one */
+    index->index_file = fopen (index_name, "r+b");
+
+    if (index->index_file == NULL || !read_header (index)
+        || !index_matches (index, file, size))
+    {
+        if (index->index_file != NULL)
+            fclose (index->index_file);
+
+        index->index_file = fopen (index_name, "w+b");
+        index->stride = LINEIDX_STRIDE;
+        index->indexed_size = 0;
+        index->line_count = 0;
+        index->fingerprint = 0;
+    }
+
+    free (index_name);
+
+  /** Bring it up to date */
+    if (index->index_file == NULL
+        || ((unsigned long) size != index->indexed_size
+            && !extend_index (index, file)))
+    {
+        if (index->index_file != NULL)
+            fclose (index->index_file);
+
+        free (index);
+        fseek (file, 0L, SEEK_SET);
+
+        return NULL;
+    }
+
+    index->partial_line = (unsigned long) size != index->indexed_size;
+
+    fseek (file, 0L, SEEK_SET);
+    stats.seeks++;
+
+    return index;
+}
+
+unsigned long line_index_lines (line_index index)
+{
+    return index->line_count + (index->partial_line ? 1 : 0);
+}
+
+unsigned long line_index_seek (line_index index, FILE * file,
+                               unsigned long line)
+{
+    unsigned long entry = line / index->stride;
+    unsigned long offset = 0;
+    unsigned char bytes[4];
+
+  /** Closest indexed line */
+    // Line 0 is not in the index, it starts at 0
+    if (entry > index->line_count / index->stride)
+        entry = index->line_count / index->stride;
+
+    if (entry > 0)
+    {
+        if (0 != fseek (index->index_file, LINEIDX_HEADER + 4 * (entry - 1),
+                        SEEK_SET)
+            || 1 != fread (bytes, 4, 1, index->index_file))
+        {
+            //Can't read the index, start from the top
+            entry = 0;
+        }
+        else
+            offset = get_number (bytes);
+
+        stats.seeks++;
+        stats.read_calls++;
+    }
+
+  /** Go there */
+    if (0 != fseek (file, offset, SEEK_SET))
+    {
+        fprintf (stderr, "Filesystem error\n");
+        exit (EXIT_FAILURE);
+    }
+
+    stats.seeks++;
+
+    return entry * index->stride;
+}
+
+void line_index_close (line_index index)
+{
+    fclose (index->index_file);
+    free (index);
+}
@@ -0,0 +1,95 @@
+/**
+ * Line index for Agon Light
+ *
+ * Jumping to line N of a large file without reading all lines before it
+ *
+ * By E.M. From
+ *
+ * head and tail are run over the same large, growing logs again and
+ * again. The line index is a file next to the log (the log's name with
+ * .idx added) that holds the offset of every LINEIDX_STRIDE-th line.
+ * It is made the first time it is needed. When the log has grown, only
+ * the new part is read and the index is extended.
+ *
+ * To get to line N, the offset of the closest indexed line before it
+ * is read straight from the index file (one seek, one small read),
+ * and at most LINEIDX_STRIDE - 1 lines are skipped from there.
+ *
+ * The index file:
+ *
+ *   magic           "LID2"
+ *   stride          lines between the indexed lines
+ *   indexed size    bytes of the log that have been indexed, up to
+ *                   and including the last '\n'
+ *   line count      '\n's in the indexed part
+ *   fingerprint     checksum of the first and the last 256 bytes of
+ *                   the indexed part
+ *   offsets         where line stride, 2 * stride, ... start
+ *                   (counting lines from 0), one for every full
+ *                   stride in line count
+ *
+ * All numbers are 32 bits, little endian, so the index works on
+ * the Agon and on the host build alike. Logs must be under 4GB.
+ *
+ * If the log is shorter than the indexed size, or the bytes the
+ * fingerprint was made from changed, it was not appended to but
+ * replaced, and the index is made again from the start.
+ *
+ */
+
+#ifndef LINEIDX_H
+#define LINEIDX_H
+
+#include <stdio.h>
+
+/**
+ * Lines between indexed lines
+ *
+ * A larger stride makes a smaller index but more lines to skip
+ */
+#ifndef LINEIDX_STRIDE
+#define LINEIDX_STRIDE 256
+#endif
+
+/**
+ * The index
+ *
+ * What is inside is private to lineidx.c
+ */
+typedef struct line_index_s *line_index;
+
+/**
+ * Open the index of file, called filename
+ *
+ * The index is made or brought up to date with the end of the file.
+ * Returns NULL if there is no index and one can't be made (the
+ * folder is read only, for example), the file should then be read
+ * the usual way.
+ *
+ * The file is left at its start.
+ */
+line_index line_index_open (FILE * file, const char *filename);
+
+/**
+ * Number of lines in the file
+ *
+ * A last line without a '\n' counts as a line
+ */
+unsigned long line_index_lines (line_index index);
+
+/**
+ * Move file to the closest indexed line at or before line
+ *
+ * Lines are counted from 0. Returns the line the file was moved to,
+ * the caller skips lines from there.
+ */
+unsigned long line_index_seek (line_index index, FILE * file,
+                               unsigned long line);
+
+/**
+ * Close the index
+ *
+ */
+void line_index_close (line_index index);
+
+#endif
@@ -0,0 +1,481 @@
+/**
+ * LZ4 reading for Agon Light
+ *
+ * Reading files compressed with lz4 as if they were not compressed
+ *
+ * By E.M. From
+ *
+ * See lz4read.h for how to use it
+ *
+ * A frame is a header, blocks and an end mark. Each block is either
+ * stored as it is, or LZ4 compressed: a list of sequences, each made
+ * of some literal bytes followed by a copy of earlier output (offset
+ * back, length). Blocks are decompressed one at a time into the
+ * buffer and handed out from there.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4read.h"
+#include "stats.h"
+
+/**
+ * How far back a copy can reach
+ *
+ */
+#define LZ4_WINDOW (64L * 1024)
+
+/**
+ * Start of every frame
+ *
+ */
+static const unsigned char lz4_magic[4] = { 0x04, 0x22, 0x4D, 0x18 };
+
+/**
+ * Everything the decompressor needs to keep track of
+ *
+ */
+struct lz4_reader_s
+{
+    FILE *file;
+
+    //From the frame header
+    bool independent;
+    bool block_checksum;
+    bool content_checksum;
+    size_t block_max;
+
+    //A compressed block, as read from the file
+    unsigned char *in;
+
+    //History (if blocks depend on each other) and the last block
+    char *buf;
+    size_t buf_size;
+    size_t filled;
+
+    //Decompressed data not handed out yet
+    char *data;
+    size_t length;
+
+    //Have we reached the end of the last frame?
+    bool end;
+
+    //Why reading stopped early, NULL if it didn't
+    const char *error;
+};
+
+/**
+ * Helper function to exit with an error message
+ *
+ * Only for errors that leave nothing to go on with, problems with
+ * the file itself are handed to the utility (see lz4_fail)
+ *
+ */
+static void lz4_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Stop reading the file, because of what message says
+ *
+ * The file ends here, the utility can report the message and go on
+ * with its next file. Returns false, for the callers to return.
+ *
+ */
+static bool lz4_fail (lz4_reader reader, const char *message)
+{
+    if (reader->error == NULL)
+        reader->error = message;
+
+    reader->end = true;
+    reader->length = 0;
+
+    return false;
+}
+
+/**
+ * Read count bytes of the file
+ *
+ * Returns false if the file ended first
+ *
+ */
+static bool lz4_read_bytes (lz4_reader reader, void *data, size_t count)
+{
+    size_t got = fread (data, 1, count, reader->file);
+
+    stats.read_calls++;
+    stats.bytes_read += got;
+
+    if (got != count && ferror (reader->file))
+        lz4_error ("Error reading from file");
+
+    return got == count;
+}
+
+/**
+ * Get a little endian number from bytes
+ *
+ */
+static unsigned long lz4_number (const unsigned char *bytes, int count)
+{
+    unsigned long value = 0;
+
+    while (count-- > 0)
+        value = (value << 8) | bytes[count];
+
+    return value;
+}
+
+/**
+ * Read a frame header
+ *
+ * Returns false at the end of the file, or if the frame can't be read
+ *
+ */
+static bool lz4_frame (lz4_reader reader)
+{
+    unsigned char header[4 + 2 + 8 + 1];
+    size_t block_max;
+    size_t buf_size;
+
+  /** Magic number */
+    if (!lz4_read_bytes (reader, header, 4))
+        return false;
+
+    if (memcmp (header, lz4_magic, 4) != 0)
+        return lz4_fail (reader, "Not an LZ4 file");
+
+  /** Flags and block size */
+    if (!lz4_read_bytes (reader, header + 4, 2))
+        return lz4_fail (reader, "Compressed file is cut short");
+
+    //Version 01, no dictionary
+    if ((header[4] & 0xC0) != 0x40 || (header[4] & 0x01))
+        return lz4_fail (reader, "Unknown LZ4 version or dictionary");
+
+    reader->independent = header[4] & 0x20;
+    reader->block_checksum = header[4] & 0x10;
+    reader->content_checksum = header[4] & 0x04;
+
+    //4 is 64KB, 5 256KB, 6 1MB, 7 4MB
+    int size_code = (header[5] >> 4) & 7;
+
+    if (size_code < 4)
+        return lz4_fail (reader, "Unknown LZ4 block size");
+
+    if ((64L << (2 * (size_code - 4))) * 1024 > LZ4READ_MAX_BLOCK)
+        return lz4_fail (reader,
+                         "LZ4 blocks too large, compress with lz4 -B4");
+
+    block_max = (64L << (2 * (size_code - 4))) * 1024;
+
+  /** Content size (skipped) and header checksum (not checked) */
+    if (!lz4_read_bytes (reader, header + 6, (header[4] & 0x08) ? 9 : 1))
+        return lz4_fail (reader, "Compressed file is cut short");
+
+  /** Make room */
+    buf_size = block_max + (reader->independent ? 0 : LZ4_WINDOW);
+
+    if (block_max > reader->block_max)
+    {
+        free (reader->in);
+
+        if ((reader->in = malloc (block_max)) == NULL)
+            lz4_error ("Could not allocate memory");
+
+        stats.allocations++;
+        reader->block_max = block_max;
+    }
+
+    if (buf_size > reader->buf_size)
+    {
+        free (reader->buf);
+
+        if ((reader->buf = malloc (buf_size)) == NULL)
+            lz4_error ("Could not allocate memory");
+
+        stats.allocations++;
+        reader->buf_size = buf_size;
+    }
+
+    //History does not go from one frame into the next
+    reader->filled = 0;
+
+    return true;
+}
+
+/**
+ * Read the extra bytes of a length, adding them to length
+ *
+ * Lengths of 15 and up go on in bytes of 255, until one that isn't
+ *
+ * Returns false if the block ends first
+ *
+ */
+static bool lz4_length (const unsigned char **in,
+                        const unsigned char *in_end, size_t *length)
+{
+    unsigned char byte;
+
+    do
+    {
+        if (*in >= in_end)
+            return false;
+
+        byte = *(*in)++;
+        *length += byte;
+    }
+    while (byte == 255);
+
+    return true;
+}
+
+/**
+ * Decompress a block of in_length bytes from in to out
+ *
+ * Copies may reach back to window, out has room for out_size bytes.
+ * The length of the decompressed data is left in decoded.
+ *
+ * Returns false if the block is damaged
+ *
+ */
+static bool lz4_decode (const unsigned char *in, size_t in_length,
+                        char *out, size_t out_size, const char *window,
+                        size_t *decoded)
+{
+    const unsigned char *in_end = in + in_length;
+    char *here = out;
+    char *out_end = out + out_size;
+
+    for (;;)
+    {
+        if (in >= in_end)
+            return false;
+
+        unsigned char token = *in++;
+
+      /** Literals */
+        size_t length = token >> 4;
+
+        if (length == 15 && !lz4_length (&in, in_end, &length))
+            return false;
+
+        if (length > (size_t) (in_end - in)
+            || length > (size_t) (out_end - here))
+            return false;
+
+        memcpy (here, in, length);
+        here += length;
+        in += length;
+
+        //The last sequence has only literals
+        if (in == in_end)
+            break;
+
+      /** Copy of earlier output */
+        if (in_end - in < 2)
+            return false;
+
+        size_t offset = in[0] | ((size_t) in[1] << 8);
+
+        in += 2;
+
+        if (offset == 0 || offset > (size_t) (here - window))
+            return false;
+
+        length = token & 15;
+
+        if (length == 15 && !lz4_length (&in, in_end, &length))
+            return false;
+
+        length += 4;
+
+        if (length > (size_t) (out_end - here))
+            return false;
+
+        //The copy may overlap what it is copying, e.g. a run of one byte
+        const char *match = here - offset;
+
+        if (offset >= length)
+        {
+            memcpy (here, match, length);
+            here += length;
+        }
+        else
+            while (length-- > 0)
+                *here++ = *match++;
+    }
+
+    *decoded = here - out;
+
+    return true;
+}
+
+/**
+ * Decompress the next block
+ *
+ * Returns false at the end of the file, or if the block can't be read
+ *
+ */
+static bool lz4_block (lz4_reader reader)
+{
+    unsigned char bytes[4];
+    unsigned long size;
+    char *out;
+
+  /** Block size, 0 is the end of the frame */
+    for (;;)
+    {
+        if (!lz4_read_bytes (reader, bytes, 4))
+            return lz4_fail (reader, "Compressed file is cut short");
+
+        if ((size = lz4_number (bytes, 4)) != 0)
+            break;
+
+        //Skip the content checksum, and go on with the next frame
+        if (reader->content_checksum && !lz4_read_bytes (reader, bytes, 4))
+            return lz4_fail (reader, "Compressed file is cut short");
+
+        if (!lz4_frame (reader))
+            return false;
+    }
+
+  /** Keep the history this block can copy from */
+    if (reader->independent)
+        reader->filled = 0;
+    else if (reader->filled > LZ4_WINDOW)
+    {
+        memmove (reader->buf, reader->buf + reader->filled - LZ4_WINDOW,
+                 LZ4_WINDOW);
+        reader->filled = LZ4_WINDOW;
+    }
+
+    out = reader->buf + reader->filled;
+
+  /** Stored or compressed? */
+    // The top bit says it is stored
+    bool stored = size & 0x80000000UL;
+
+    size &= 0x7FFFFFFFUL;
+
+    if (size > reader->block_max)
+        return lz4_fail (reader, "Compressed file is damaged");
+
+    if (stored)
+    {
+        if (!lz4_read_bytes (reader, out, size))
+            return lz4_fail (reader, "Compressed file is cut short");
+
+        reader->length = size;
+    }
+    else
+    {
+        if (!lz4_read_bytes (reader, reader->in, size))
+            return lz4_fail (reader, "Compressed file is cut short");
+
+        if (!lz4_decode (reader->in, size, out, reader->block_max,
+                         reader->buf, &reader->length))
+            return lz4_fail (reader, "Compressed file is damaged");
+    }
+
+  /** Skip the block checksum */
+    if (reader->block_checksum && !lz4_read_bytes (reader, bytes, 4))
+        return lz4_fail (reader, "Compressed file is cut short");
+
+    reader->data = out;
+    reader->filled += reader->length;
+
+    return true;
+}
+
+bool lz4_magic_at (const unsigned char *start)
+{
+    return memcmp (start, lz4_magic, 4) == 0;
+}
+
+bool lz4_detect (FILE * file)
+{
+    unsigned char magic[4];
+    long position;
+    size_t got;
+
+    //Pipes can't go back
+    if ((position = ftell (file)) == -1)
+        return false;
+
+    got = fread (magic, 1, 4, file);
+
+    if (0 != fseek (file, position, SEEK_SET))
+        lz4_error ("Filesystem error");
+
+    stats.read_calls++;
+    stats.seeks++;
+
+    return got == 4 && lz4_magic_at (magic);
+}
+
+lz4_reader lz4_reader_open (FILE * file)
+{
+    lz4_reader reader;
+
+    if ((reader = calloc (1, sizeof (struct lz4_reader_s))) == NULL)
+        lz4_error ("Could not allocate memory");
+
+    stats.allocations++;
+
+    reader->file = file;
+
+    //A frame that can't be read leaves the reader with an error
+    // and no data
+    if (!lz4_frame (reader))
+        lz4_fail (reader, "Not an LZ4 file");
+
+    return reader;
+}
+
+size_t lz4_reader_read (lz4_reader reader, char *data, size_t count)
+{
+    size_t done = 0;
+
+    while (done < count)
+    {
+      /** Out of data? Decompress some more */
+        if (reader->length == 0)
+        {
+            if (reader->end || !lz4_block (reader))
+            {
+                reader->end = true;
+                break;
+            }
+
+            continue;
+        }
+
+      /** Hand out what we have */
+        size_t length = count - done < reader->length ?
+            count - done : reader->length;
+
+        memcpy (data + done, reader->data, length);
+        reader->data += length;
+        reader->length -= length;
+        done += length;
+    }
+
+    return done;
+}
+
+const char *lz4_reader_error (lz4_reader reader)
+{
+    return reader->error;
+}
+
+void lz4_reader_close (lz4_reader reader)
+{
+    free (reader->in);
+    free (reader->buf);
+    free (reader);
+}
@@ -0,0 +1,106 @@
+/**
+ * LZ4 reading for Agon Light
+ *
+ * Reading files compressed with lz4 as if they were not compressed
+ *
+ * By E.M. From
+ *
+ * Reading from the sdcard is the slowest part of most utilities, and
+ * logs compress well. The block reader (see blockio.h) checks every
+ * file it opens for the LZ4 frame magic number and, if it is there,
+ * reads the file through the decompressor here. grep, wc, head and
+ * strings then work on the text as usual, while a lot less is read
+ * from the card.
+ *
+ * The format is the LZ4 frame format, as written by pack or by the lz4
+ * command on a PC. LZ4 is fast to decompress on a small CPU: it only
+ * copies literals and earlier output, there are no bits to pick apart
+ * and no tables to build.
+ *
+ * The decompressor needs a buffer as large as the largest block in
+ * the file, plus 64KB of history if the blocks depend on each other.
+ * On the Agon blocks can be at most 64KB, pack makes those, or
+ * compress with lz4 -B4 (blocks of 64KB). Blocks are independent
+ * by default.
+ *
+ * The checksums a frame can have are skipped, not checked. Damaged
+ * data is still caught where it would read or write outside of the
+ * buffers. Reading the file stops there, see lz4_reader_error().
+ *
+ * Only files that can be seeked in are checked, not pipes.
+ *
+ */
+
+#ifndef LZ4READ_H
+#define LZ4READ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Largest block that can be read
+ *
+ * 64KB on the Agon, 4MB (the largest lz4 makes) on the host
+ */
+#ifndef LZ4READ_MAX_BLOCK
+#ifdef HOST_BUILD
+#define LZ4READ_MAX_BLOCK (4L * 1024 * 1024)
+#else
+#define LZ4READ_MAX_BLOCK (64L * 1024)
+#endif
+#endif
+
+/**
+ * The decompressor
+ *
+ * What is inside is private to lz4read.c
+ */
+typedef struct lz4_reader_s *lz4_reader;
+
+/**
+ * Are the 4 bytes at start the start of an LZ4 frame?
+ *
+ */
+bool lz4_magic_at (const unsigned char *start);
+
+/**
+ * Does file start with an LZ4 frame, from where it is now?
+ *
+ * The file is left where it was. Always false for pipes.
+ */
+bool lz4_detect (FILE * file);
+
+/**
+ * Start decompressing file
+ *
+ * The file must be at the start of an LZ4 frame
+ */
+lz4_reader lz4_reader_open (FILE * file);
+
+/**
+ * Decompress up to count bytes into data
+ *
+ * Returns the number of bytes, less than count only at the end
+ * of the file
+ */
+size_t lz4_reader_read (lz4_reader reader, char *data, size_t count);
+
+/**
+ * Why the file ended early, NULL if it didn't
+ *
+ * A frame that can't be read (damaged, cut short, blocks larger than
+ * LZ4READ_MAX_BLOCK) ends the file there, instead of ending the
+ * utility. It can then report the message and go on with its next
+ * file. The message is a constant, it stays after closing.
+ */
+const char *lz4_reader_error (lz4_reader reader);
+
+/**
+ * Free a decompressor
+ *
+ * The file is not closed
+ */
+void lz4_reader_close (lz4_reader reader);
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * Output for Agon Light
+ *
+ * Writing characters and numbers without printf
+ *
+ * By E.M. From
+ *
+ * See output.h for how to use it
+ *
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <mos_api.h>
+
+#include "output.h"
+
+//Set by -u
+static bool unbuffered = false;
+
+/**
+ * All numbers from 00 to 99, two characters each
+ *
+ */
+static const char digit_pairs[] =
+    "00010203040506070809" "10111213141516171819"
+    "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+size_t format_number (char *text, unsigned long value, int radix,
+                      int width)
+{
+    //The digits are worked out from the right
+    char digits[OUTPUT_NUMBER_MAX];
+    char *start = digits + sizeof (digits);
+
+  /** Hexadecimal, a shift per digit */
+    if (radix == 16)
+    {
+        do
+        {
+            *--start = hex_digits[value & 15];
+            value >>= 4;
+        }
+        while (value != 0);
+    }
+
+  /** Decimal, two digits per division */
+    else
+    {
+        while (value >= 100)
+        {
+            const char *pair = digit_pairs + (value % 100) * 2;
+
+            value /= 100;
+            *--start = pair[1];
+            *--start = pair[0];
+        }
+
+        //One or two digits left
+        if (value >= 10)
+        {
+            *--start = digit_pairs[value * 2 + 1];
+            *--start = digit_pairs[value * 2];
+        }
+        else
+            *--start = '0' + value;
+    }
+
+  /** Pad and copy */
+    size_t length = digits + sizeof (digits) - start;
+    size_t padding = width > 0 && (size_t) width > length ?
+        width - length : 0;
+
+    memset (text, ' ', padding);
+    memcpy (text + padding, start, length);
+
+    return padding + length;
+}
+
+void output_char (block_writer writer, char ch)
+{
+    block_writer_write (writer, &ch, 1);
+}
+
+void output_number (block_writer writer, unsigned long value, int radix,
+                    int width)
+{
+    char text[OUTPUT_NUMBER_MAX + OUTPUT_WIDTH_MAX];
+
+    if (width > OUTPUT_WIDTH_MAX)
+        width = OUTPUT_WIDTH_MAX;
+
+    block_writer_write (writer, text,
+                        format_number (text, value, radix, width));
+}
+
+void output_unbuffered (void)
+{
+    unbuffered = true;
+}
+
+/**
+ * Sink for the console writer, one block to the VDP
+ *
+ */
+static void console_sink (const char *data, size_t length)
+{
+    mos_puts ((char *) data, length, 0);
+}
+
+block_writer output_console (void)
+{
+    int flags = 0;
+
+#ifdef OUTPUT_CRLF
+    flags |= BLOCK_WRITER_CRLF;
+#endif
+
+    if (unbuffered)
+        flags |= BLOCK_WRITER_UNBUFFERED;
+
+    return block_writer_open_sink (console_sink, 0, flags);
+}
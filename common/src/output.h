@@ -0,0 +1,97 @@
+/**
+ * Output for Agon Light
+ *
+ * Writing characters and numbers without printf
+ *
+ * By E.M. From
+ *
+ * printf has to look at its format string every time it is called
+ * and pulls a lot of code into every utility. The functions here do
+ * the few things the utilities need printf for, straight into a
+ * block writer (see blockio.h).
+ *
+ * Numbers are turned into text two decimal digits at a time, which
+ * halves the number of (slow, 32-bit) divisions on the eZ80.
+ *
+ * The console writer sends what the utilities print to the VDP in
+ * large blocks with mos_puts, one call per buffer instead of one (or
+ * more) per line. \n is made into the \r\n the VDP needs while the
+ * text is copied into the buffer. With -u every write is sent right
+ * away instead, so a slow search shows its lines as they are found.
+ *
+ * In the host build mos_puts is a stand-in that writes to stdout
+ * (see host/include/mos_api.h), and \n is left as it is so the output
+ * can be compared with other tools. The write calls in the -S report
+ * are the mos_puts calls. Define OUTPUT_CRLF to get \r\n anyway.
+ *
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+#include "blockio.h"
+
+/**
+ * Longest number format_number() writes, without padding
+ *
+ * An unsigned long in decimal, 32 or 64 bits
+ */
+#define OUTPUT_NUMBER_MAX 20
+
+/**
+ * Widest padding asked for, longer numbers are not cut off
+ *
+ */
+#define OUTPUT_WIDTH_MAX 20
+
+/**
+ * Make \n into \r\n on the console?
+ *
+ * Always on the Agon, see above for the host
+ */
+#ifndef HOST_BUILD
+#define OUTPUT_CRLF
+#endif
+
+/**
+ * Write value as text in radix 10 or 16 (lowercase) to text
+ *
+ * The number is padded with spaces at the front to width characters.
+ * text must have room for OUTPUT_NUMBER_MAX or width characters,
+ * whichever is more. It is NOT '\0' terminated.
+ * Returns the number of characters written.
+ */
+size_t format_number (char *text, unsigned long value, int radix,
+                      int width);
+
+/**
+ * Write a single character
+ *
+ */
+void output_char (block_writer writer, char ch);
+
+/**
+ * Write value as text, see format_number()
+ *
+ * width is at most OUTPUT_WIDTH_MAX
+ */
+void output_number (block_writer writer, unsigned long value, int radix,
+                    int width);
+
+/**
+ * Make console writers opened after this unbuffered
+ *
+ * Called when the -u option is found
+ */
+void output_unbuffered (void);
+
+/**
+ * Create a writer to the console
+ *
+ * Closed with block_writer_close() like any other writer
+ */
+block_writer output_console (void);
+
+#endif
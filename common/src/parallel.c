@@ -0,0 +1,220 @@
+/**
+ * Parallel scanning for the host build
+ *
+ * Splitting a file into chunks that are scanned on several threads
+ *
+ * By E.M. From
+ *
+ * See parallel.h for how to use it
+ *
+ * Work is done in rounds. The main thread works out where the next
+ * chunks start and end, starts a thread for each chunk, waits for
+ * all of them and merges their results in order. Each thread reads
+ * its own chunk with pread(), so they don't share a file position.
+ *
+ */
+
+#ifdef HOST_BUILD
+
+#define _XOPEN_SOURCE 700
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lz4read.h"
+#include "parallel.h"
+#include "stats.h"
+
+/**
+ * One chunk and the thread working on it
+ *
+ */
+struct chunk_s
+{
+    pthread_t thread;
+
+    //Where the chunk is in the file
+    int fd;
+    off_t start;
+    size_t length;
+
+    //Buffer it is read into, kept from round to round
+    char *buf;
+    size_t size;
+
+    //What to do with it and where to leave the result
+    parallel_scan_fn scan;
+    void *result;
+};
+
+/**
+ * Helper function to exit with an error message
+ *
+ */
+static void parallel_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Read and scan a chunk, on its own thread
+ *
+ */
+static void *scan_chunk (void *arg)
+{
+    struct chunk_s *chunk = arg;
+    size_t done = 0;
+
+    while (done < chunk->length)
+    {
+        ssize_t got = pread (chunk->fd, chunk->buf + done,
+                             chunk->length - done, chunk->start + done);
+
+        if (got <= 0)
+            parallel_error ("Error reading from file");
+
+        done += got;
+    }
+
+    chunk->scan (chunk->buf, chunk->length, chunk->result);
+
+    return NULL;
+}
+
+/**
+ * Find where the line going on at position ends
+ *
+ * Returns the offset after the first '\n' at or after position - 1,
+ * or size if there is none
+ *
+ */
+static off_t line_end (int fd, off_t position, off_t size)
+{
+    char block[4096];
+
+    for (position--; position < size; position += sizeof (block))
+    {
+        ssize_t got = pread (fd, block, sizeof (block), position);
+        char *newline;
+
+        if (got <= 0)
+            parallel_error ("Error reading from file");
+
+        stats.read_calls++;
+
+        if ((newline = memchr (block, '\n', got)) != NULL)
+            return position + (newline - block) + 1;
+    }
+
+    return size;
+}
+
+bool parallel_scan (FILE * file, int threads, bool lines,
+                    size_t result_size, parallel_scan_fn scan,
+                    parallel_merge_fn merge)
+{
+    int fd = fileno (file);
+    off_t size;
+
+  /** Can the file be split up? */
+    // It has to have a size and allow reads anywhere in it
+    // and not be compressed, those have to be read from the start
+#ifndef BLOCKIO_NO_LZ4
+    unsigned char magic[4];
+
+    if (pread (fd, magic, 4, 0) == 4 && lz4_magic_at (magic))
+        return false;
+#endif
+
+    if ((size = lseek (fd, 0, SEEK_END)) == -1)
+        return false;
+
+    if (threads < 1)
+        threads = 1;
+
+    if (threads > PARALLEL_MAX)
+        threads = PARALLEL_MAX;
+
+  /** Allocate space */
+    struct chunk_s *chunks = calloc (threads, sizeof (struct chunk_s));
+    char *results = malloc (threads * result_size);
+
+    if (chunks == NULL || results == NULL)
+        parallel_error ("Could not allocate memory");
+
+    stats.allocations += 2;
+
+  /** Go through the file a round at a time */
+    off_t position = 0;
+
+    while (position < size)
+    {
+        int count;
+
+      /** Where do the chunks of this round start and end? */
+        for (count = 0; count < threads && position < size; count++)
+        {
+            struct chunk_s *chunk = &chunks[count];
+            off_t end = position + PARALLEL_CHUNK;
+
+            if (end >= size)
+                end = size;
+            else if (lines)
+                end = line_end (fd, end, size);
+
+            chunk->fd = fd;
+            chunk->start = position;
+            chunk->length = end - position;
+            chunk->scan = scan;
+            chunk->result = results + count * result_size;
+
+            //A chunk with a long line may not fit the buffer
+            if (chunk->length > chunk->size)
+            {
+                free (chunk->buf);
+                chunk->size = chunk->length;
+
+                if ((chunk->buf = malloc (chunk->size)) == NULL)
+                    parallel_error ("Could not allocate memory");
+
+                stats.allocations++;
+            }
+
+            position = end;
+        }
+
+      /** Scan them */
+        memset (results, 0, count * result_size);
+
+        for (int i = 0; i < count; i++)
+            if (pthread_create (&chunks[i].thread, NULL, scan_chunk,
+                                &chunks[i]) != 0)
+                parallel_error ("Could not start thread");
+
+        for (int i = 0; i < count; i++)
+        {
+            pthread_join (chunks[i].thread, NULL);
+
+            stats.read_calls++;
+            stats.bytes_read += chunks[i].length;
+        }
+
+      /** Put the results together, in order */
+        for (int i = 0; i < count; i++)
+            merge (chunks[i].result);
+    }
+
+  /** Clean up */
+    for (int i = 0; i < threads; i++)
+        free (chunks[i].buf);
+
+    free (chunks);
+    free (results);
+
+    return true;
+}
+
+#endif
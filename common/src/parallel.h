@@ -0,0 +1,81 @@
+/**
+ * Parallel scanning for the host build
+ *
+ * Splitting a file into chunks that are scanned on several threads
+ *
+ * By E.M. From
+ *
+ * On a Linux host the utilities are also run over large files, like
+ * exported sdcard images. With -j N, wc and grep split the file into
+ * chunks and scan N of them at a time, each on a thread of its own.
+ *
+ * Every chunk gets a result of its own. When a round of chunks is
+ * done, the results are handed to the utility in file order, so it
+ * can put them together the way it needs to: carry the word state
+ * from one chunk to the next (wc), print the matching lines in the
+ * order they are in the file (grep).
+ *
+ * Chunks can be made to start and end on line boundaries, a chunk
+ * then holds whole lines only, however long they are.
+ *
+ * The Agon has one core and no threads, this is host build only.
+ *
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#ifdef HOST_BUILD
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Size of a chunk
+ *
+ * Chunks split on line boundaries are longer, up to the next '\n'
+ */
+#ifndef PARALLEL_CHUNK
+#define PARALLEL_CHUNK (1024 * 1024)
+#endif
+
+/**
+ * Most threads that can be asked for
+ *
+ */
+#define PARALLEL_MAX 64
+
+/**
+ * Scan length bytes of chunk, leaving what was found in result
+ *
+ * Called on a worker thread, it must not touch anything shared
+ * but read only data. result is zeroed before the call.
+ */
+typedef void (*parallel_scan_fn) (const char *chunk, size_t length,
+                                  void *result);
+
+/**
+ * Put the result of a chunk together with the ones before it
+ *
+ * Called on the main thread, once for every chunk, in file order
+ */
+typedef void (*parallel_merge_fn) (void *result);
+
+/**
+ * Scan file with threads threads
+ *
+ * Every chunk is scanned by scan, its result (of result_size bytes)
+ * is then handed to merge. With lines set, chunks only hold whole lines.
+ *
+ * Returns false, without reading anything, if the file can't be
+ * split up (stdin from a pipe for example). The caller should then
+ * read it the usual way.
+ */
+bool parallel_scan (FILE * file, int threads, bool lines,
+                    size_t result_size, parallel_scan_fn scan,
+                    parallel_merge_fn merge);
+
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * I/O statistics for Agon Light
+ *
+ * Counters shared by the utilities, shown with -S
+ *
+ * By E.M. From
+ *
+ * See stats.h for how to use it
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "stats.h"
+
+/**
+ * Most counters a utility can add
+ *
+ */
+#define MAX_EXTRA 4
+
+/**
+ * The counters
+ *
+ */
+struct io_stats stats;
+
+/**
+ * Report turned on?
+ *
+ */
+static bool enabled = false;
+
+/**
+ * Clock when stats_start() was called
+ *
+ */
+static clock_t start_ticks;
+
+/**
+ * The utility's own counters
+ *
+ */
+static const char *extra_names[MAX_EXTRA];
+static unsigned long extra_values[MAX_EXTRA];
+static int extra_count = 0;
+
+void stats_start (void)
+{
+    enabled = true;
+    start_ticks = clock ();
+}
+
+void stats_extra (const char *name, unsigned long value)
+{
+    //No room? Then it is left out
+    if (extra_count == MAX_EXTRA)
+        return;
+
+    extra_names[extra_count] = name;
+    extra_values[extra_count++] = value;
+}
+
+void stats_report (void)
+{
+    if (!enabled)
+        return;
+
+    fprintf (stderr, "bytes read     %lu\r\n", stats.bytes_read);
+    fprintf (stderr, "read calls     %lu\r\n", stats.read_calls);
+    fprintf (stderr, "seeks          %lu\r\n", stats.seeks);
+    fprintf (stderr, "bytes written  %lu\r\n", stats.bytes_written);
+    fprintf (stderr, "write calls    %lu\r\n", stats.write_calls);
+    fprintf (stderr, "allocations    %lu\r\n", stats.allocations);
+
+    for (int i = 0; i < extra_count; i++)
+        fprintf (stderr, "%-14s %lu\r\n", extra_names[i], extra_values[i]);
+
+    fprintf (stderr, "ticks          %lu (%lu per second)\r\n",
+             (unsigned long) (clock () - start_ticks),
+             (unsigned long) CLOCKS_PER_SEC);
+}
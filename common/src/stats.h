@@ -0,0 +1,61 @@
+/**
+ * I/O statistics for Agon Light
+ *
+ * Counters shared by the utilities, shown with -S
+ *
+ * By E.M. From
+ *
+ * When a utility is slow it helps to know where the time goes,
+ * reading from the sdcard, looking at the data or writing to the
+ * screen. The block reader and writer count what they do in the
+ * counters below, and utilities can add counters of their own
+ * with stats_extra().
+ *
+ * Counting is always done, it is only a few additions.
+ * The report is only printed (to stderr) if -S was given.
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+
+/**
+ * The counters
+ *
+ */
+struct io_stats
+{
+    unsigned long bytes_read;
+    unsigned long read_calls;
+    unsigned long seeks;
+    unsigned long bytes_written;
+    unsigned long write_calls;
+    unsigned long allocations;
+};
+
+extern struct io_stats stats;
+
+/**
+ * Turn on the report and start timing
+ *
+ * Called when the -S option is found
+ */
+void stats_start (void);
+
+/**
+ * Add a counter of the utility's own to the report
+ *
+ * name has to stay valid until stats_report() is called
+ */
+void stats_extra (const char *name, unsigned long value);
+
+/**
+ * Print the report to stderr, if turned on
+ *
+ * Utilities call this just before they exit
+ */
+void stats_report (void);
+
+#endif
@@ -6,8 +6,14 @@
  * Original by Vasco Costa
  * Modifications by E.M. From
  *
- * Options recognized are -n to not add a newline to output
- * and -h for help
+ * Options recognized are -n to not add a newline to output,
+ * -e to interpret escapes and -h for help
+ *
+ * With -x the arguments are lists of byte values instead of text,
+ * which are sent out as one binary block. This is the fast way of
+ * sending VDU sequences to the VDP. -f reads the lists from a file.
+ *
+ * -S shows I/O statistics
  *
  */
 
@@ -17,16 +23,364 @@
 #include <stdlib.h>
 #include <ctype.h>
 
+#include "stats.h"
+
 /**
  * Helper function to print a help message
  *
  */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s -[hne] string\n", prog_name);
+    printf ("Usage: %s -[hnexS] [-f file] string\n", prog_name);
     printf ("-h show this help message\n");
     printf ("-n supress trailing newline\n");
     printf ("-e interpret \"\\\" escapes\n");
+    printf ("-x arguments are byte values, e.g. 22,1 &1F 0x10 640;\n");
+    printf ("-f file read byte values from file\n");
+    printf ("-S show I/O statistics\n");
+}
+
+/**
+ * Lookup table for digits
+ *
+ * Holds the value of a hex digit plus one, so that
+ * 0 can mean "not a digit". Avoids a chain of range checks
+ * for every digit converted.
+ *
+ */
+const unsigned char digit_table[256] = {
+    ['0'] = 1,['1'] = 2,['2'] = 3,['3'] = 4,['4'] = 5,
+    ['5'] = 6,['6'] = 7,['7'] = 8,['8'] = 9,['9'] = 10,
+    ['a'] = 11,['b'] = 12,['c'] = 13,['d'] = 14,['e'] = 15,['f'] = 16,
+    ['A'] = 11,['B'] = 12,['C'] = 13,['D'] = 14,['E'] = 15,['F'] = 16
+};
+
+/**
+ * Value of a digit in base 8 or 16
+ *
+ * Returns -1 if ch is not a digit in that base
+ *
+ */
+int digit_value (char ch, int base)
+{
+    int value = digit_table[(unsigned char) ch] - 1;
+
+    return value < base ? value : -1;
+}
+
+/**
+ * Replace the escape sequences in string with what they stand for
+ *
+ * The string is decoded in place in a single pass. Everything is read
+ * through one pointer and written through another, since the decoded
+ * string is never longer than the original the writing pointer never
+ * overtakes the reading one.
+ *
+ * stop is set to true if \c was found, nothing after it is printed,
+ * not even the trailing newline
+ *
+ * Returns the length of the decoded string
+ *
+ */
+size_t interpret_escapes (char *string, bool *stop)
+{
+    //Where we read from
+    char *read = string;
+
+    //Where we write to
+    char *write = string;
+
+    while (*read != '\0')
+    {
+
+      /** Plain character, copy it */
+        if (*read != '\\')
+        {
+            *write++ = *read++;
+            continue;
+        }
+
+      /** Escape sequence */
+        //Start of the sequence, used in error messages
+        char *escape = read;
+
+        //Skip the backslash
+        read++;
+
+        switch (*read++)
+        {
+            // \\     backslash
+        case '\\':
+            *write++ = '\\';
+            break;
+
+            // \a     alert (BEL)
+        case 'a':
+            *write++ = '\a';
+            break;
+
+            // \b     backspace
+        case 'b':
+            *write++ = '\b';
+            break;
+
+            // \c     produce no further output
+        case 'c':
+            *stop = true;
+            return write - string;
+
+            // \e     escape
+        case 'e':
+            *write++ = '\e';
+            break;
+
+            // \f     form feed
+        case 'f':
+            *write++ = '\f';
+            break;
+
+            // \n     new line
+        case 'n':
+            *write++ = '\n';
+            break;
+
+            // \r     carriage return
+        case 'r':
+            *write++ = '\r';
+            break;
+
+            // \t     horizontal tab
+        case 't':
+            *write++ = '\t';
+            break;
+
+            // \v     vertical tab
+        case 'v':
+            *write++ = '\v';
+            break;
+
+        /** The last two cases are numbers */
+            //Only as many digits as fit in a byte are used
+            // i.e. the pattern \xFF00 is supposed to output 3 bytes
+            // [0xFF,0x30,0x30] so 255 followed by two ascii 0s
+
+            // \0NNN octal number
+            // \xNN hex number
+        case '0':
+        case 'x':
+            {
+                bool hex = (read[-1] == 'x');
+                int base = hex ? 16 : 8;
+                int max_digits = hex ? 2 : 3;
+                int value = 0;
+                int digits;
+                int digit;
+
+                //Add up digits until we have enough or run into a non digit
+                for (digits = 0; digits < max_digits
+                     && (digit = digit_value (*read, base)) != -1; digits++)
+                {
+                    value = value * base + digit;
+                    read++;
+                }
+
+                //Check that it's valid
+                // \0 on its own is a valid NUL, \x needs at least one digit
+                if (hex && digits == 0)
+                {
+                    *read = '\0';
+                    fprintf (stderr, "Invalid escape code: %s\n", escape);
+                    exit (EXIT_FAILURE);
+                }
+
+                *write++ = (char) value;
+                break;
+            }
+
+        /** Invalid escape code */
+        default:
+            //Cut the string after the code (if there is one) for the message
+            if (read[-1] != '\0')
+                *read = '\0';
+            fprintf (stderr, "Invalid escape code: %s\n", escape);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    return write - string;
+}
+
+/**
+ * Replace a list of byte values in text with the bytes themselves
+ *
+ * Values are separated by spaces, tabs, newlines or commas and can be
+ * decimal (22), hex (&16 or 0x16) and end in ; to send a 16 bit
+ * value as two bytes, low byte first (like VDU in BBC BASIC).
+ * # starts a comment that runs to the end of the line.
+ *
+ * Like interpret_escapes() this is done in place in a single pass,
+ * a value is never shorter than the bytes it turns into.
+ *
+ * Returns the number of bytes
+ *
+ */
+size_t parse_bytes (char *text)
+{
+    //Where we read from
+    char *read = text;
+
+    //Where we write to
+    char *write = text;
+
+    while (*read != '\0')
+    {
+
+      /** Skip separators */
+        if (*read == ' ' || *read == ',' || *read == '\t'
+            || *read == '\n' || *read == '\r')
+        {
+            read++;
+            continue;
+        }
+
+      /** Skip comments */
+        if (*read == '#')
+        {
+            while (*read != '\0' && *read != '\n')
+                read++;
+            continue;
+        }
+
+      /** Value */
+        //Start of the value, used in error messages
+        char *start = read;
+        int base = 10;
+
+        //Hex prefix?
+        if (*read == '&')
+        {
+            base = 16;
+            read++;
+        }
+        else if (read[0] == '0' && (read[1] == 'x' || read[1] == 'X'))
+        {
+            base = 16;
+            read += 2;
+        }
+
+        //Add up the digits
+        long value = 0;
+        int digits = 0;
+        int digit;
+
+        while ((digit = digit_value (*read, base)) != -1 && value <= 0xFFFF)
+        {
+            value = value * base + digit;
+            read++;
+            digits++;
+        }
+
+        //16 bit value?
+        bool word = (*read == ';');
+
+        if (word)
+            read++;
+
+        //Check that it's valid
+        // It has to have digits, fit and be followed by a separator
+        if (digits == 0 || value > (word ? 0xFFFF : 0xFF)
+            || (*read != '\0' && !strchr (" ,\t\r\n#", *read)))
+        {
+            //Cut the string after the value for the message
+            while (*read != '\0' && !strchr (" ,\t\r\n#", *read))
+                read++;
+            *read = '\0';
+            fprintf (stderr, "Invalid byte value: %s\n", start);
+            exit (EXIT_FAILURE);
+        }
+
+        //Write the byte(s)
+        *write++ = (char) value;
+
+        if (word)
+            *write++ = (char) (value >> 8);
+    }
+
+    return write - text;
+}
+
+/**
+ * Load an entire file into memory as a string
+ *
+ * Exits on errors
+ *
+ */
+char *load_file (char *filename)
+{
+    FILE *file;
+    long size;
+    char *text;
+
+    if ((file = fopen (filename, "r")) == NULL)
+    {
+        fprintf (stderr, "Error opening file\n");
+        exit (EXIT_FAILURE);
+    }
+
+  /** Get the size of the file */
+    if (fseek (file, 0L, SEEK_END) != 0 || (size = ftell (file)) == -1
+        || fseek (file, 0L, SEEK_SET) != 0)
+    {
+        fprintf (stderr, "Filesystem error\n");
+        exit (EXIT_FAILURE);
+    }
+
+  /** Load it in one read */
+    // Add 1 for the terminating 0
+    if ((text = malloc (size + 1)) == NULL)
+    {
+        fprintf (stderr, "Out of memory\n");
+        exit (EXIT_FAILURE);
+    }
+
+    if (size != 0 && fread (text, size, 1, file) != 1)
+    {
+        fprintf (stderr, "Filesystem error\n");
+        exit (EXIT_FAILURE);
+    }
+
+    stats.allocations++;
+    stats.seeks += 2;
+    stats.read_calls++;
+    stats.bytes_read += size;
+
+    text[size] = '\0';
+    fclose (file);
+
+    return text;
+}
+
+/**
+ * Write a block of bytes to stdout
+ *
+ * Exits on errors
+ *
+ */
+void write_block (char *block, size_t length)
+{
+    //Nothing to write is not an error
+    if (length == 0)
+        return;
+
+    //Use fwrite(), it's faster
+    if (fwrite (block, length, 1, stdout) != 1)
+    {
+        fprintf (stderr, "Standard output error");
+        exit (EXIT_FAILURE);
+    }
+
+    stats.write_calls++;
+    stats.bytes_written += length;
 }
 
 /**
@@ -47,6 +401,12 @@ int main (int argc, char *argv[])
     //Interpret / escapes
     bool escapes = false;
 
+    //Arguments are byte values
+    bool bytes = false;
+
+    //File with byte values, if any
+    char *byte_file = NULL;
+
   /** Check if we have arguments */
     if (argc == 1)
     {
@@ -83,6 +443,28 @@ int main (int argc, char *argv[])
             escapes = true;
             break;;
 
+            //Byte values
+        case 'x':
+            bytes = true;
+            break;
+
+            //Byte values from file
+        case 'f':
+            if (++i == argc)
+            {
+                fprintf (stderr, "Missing filename\n");
+                return EXIT_FAILURE;
+            }
+
+            bytes = true;
+            byte_file = argv[i];
+            break;
+
+            //I/O statistics
+        case 'S':
+            stats_start ();
+            break;
+
             // h, user wanted to see help
         case 'h':
             show_usage (argv[0]);
@@ -95,10 +477,21 @@ int main (int argc, char *argv[])
         }
     }
 
+  /** Byte values from a file? */
+    // Sent before any on the command line
+    if (byte_file != NULL)
+    {
+        char *text = load_file (byte_file);
+
+        write_block (text, parse_bytes (text));
+        free (text);
+    }
+
   /** Check if we have anything to print */
     if (argc == first_arg_toprint)
     {
         //Nope, exit silently
+        stats_report ();
         return EXIT_SUCCESS;
     }
 
@@ -113,44 +506,44 @@ int main (int argc, char *argv[])
     // This way the three are indenpendant, aka not intertwined
     //  and therefore easier to debug and maintain
 
+    //Length of string
+    // Found in a pre-pass over the arguments, so memory is only allocated once
+    size_t string_length = 0;
+
+    for (int i = first_arg_toprint; i < argc; i++)
+    {
+        //Add 1 for the space between args
+        string_length += strlen (argv[i]) + 1;
+    }
+
     //String
+    // The space after the last argument leaves room for the terminating 0
     char *string;
 
-    //Start with length 0, i.e. with only a string terminating 0(aka NUL) in it.
-    // Do malloc(1) because the 0 itself needs a byte to be stored in
-    // If we dont add this 0 token, the string is not a valid string of length 0
-    if ((string = malloc (1)) == NULL)
+    if ((string = malloc (string_length)) == NULL)
     {
         fprintf (stderr, "Out of memory\n");
         return EXIT_FAILURE;
     }
-    //Add the terminating 0 token 
-    string[0] = '\0';
 
+    stats.allocations++;
 
-    //Length of string
-    size_t string_length = 0;
+    //Where to write the next argument
+    // Moving this along means we never have to look for the end of string,
+    // which is what strcat() does every time it is called
+    char *write_here = string;
 
     //Create the string
     for (int i = first_arg_toprint; i < argc; i++)
     {
-        //Calculatet new size so argv[1] fits in it
-        // Add 1 for the space between args
-        string_length += strlen (argv[i]) + 1;
-
-        //Get more memory
-        // Add 1 for the terminating 0
-        if ((string = realloc (string, string_length + 1)) == NULL)
-        {
-            fprintf (stderr, "Out of memory\n");
-            return EXIT_FAILURE;
-        }
+        size_t arg_length = strlen (argv[i]);
 
-        //Append argv[i] to the string
-        strcat (string, argv[i]);
+        //Copy argv[i] into the string
+        memcpy (write_here, argv[i], arg_length);
+        write_here += arg_length;
 
         //Append a space to the string
-        strcat (string, " ");
+        *write_here++ = ' ';
     }
 
   /** Remove trailing space */
@@ -162,183 +555,25 @@ int main (int argc, char *argv[])
     // This is an essential part of echo
     // Without this you cannot produce formatted output
     //  or multiline messages
-    if (escapes)
+    if (bytes)
     {
-        //Temp pointer
-        char *temp = string;
-
-        //Find next \, if any
-        while ((temp = strchr (temp, '\\')) != NULL)
-        {
-
-            char escape_code = *(temp + 1);
-
-        /** Check if it's the stop output token */
-            if (escape_code == 'c')
-            {
-                *temp = '\0';
-
-                //Update the length of the string
-                string_length = strlen (string);
-
-                //No more processing, on to printing
-                break;
-            }
-
-        /** Handle the escape code */
-            // Write the binary value of the escape sequence into the string
-
-            //Pointer to the rest of the string after the escape sequence
-            // Used to overwrite the leftover tokens in the escape
-            // Most escapes are 2 long
-            // For the other cases, it's dynamic and changes based on the conversion
-            char *rest_of_string = temp + 2;
-
-            //Length of string will go down by at least one
-            //Correct below in the other two cases
-            string_length -= 1;
-
-            //Replace the first \ in the string with the code 
-            switch (escape_code)
-            {
-                // \\     backslash
-            case '\\':
-                *temp = '\\';
-                break;
-
-                // \a     alert (BEL)
-            case 'a':
-                *temp = '\a';
-                break;
-
-                // \b     backspace
-            case 'b':
-                *temp = '\b';
-                break;
-
-                // \e     escape
-            case 'e':
-                *temp = '\e';
-                break;
-
-                // \f     form feed
-            case 'f':
-                *temp = '\f';
-                break;
-
-                // \n     new line
-            case 'n':
-                *temp = '\n';
-                break;
-
-                // \r     carriage return
-            case 'r':
-                *temp = '\n';
-                break;
-
-                // \t     horizontal tab
-            case 't':
-                *temp = '\t';
-                break;
-
-                // \v     vertical tab
-            case 'v':
-                *temp = '\v';
-                break;
-
-            /** For the last two cases we need to do a conversion */
-                //string_length needs to be incremented by one to offset
-                // the earlier subtraction for the other cases
-
-                //Create a substring by saving a value and replacing it with \0
-                // We need to do this since we are only converting one bye
-                // i.e. the pattern \xFF00 is supposed to output 3 bytes
-                // [0xFF,0x30,0x30] so 255 followed by two ascii 0s
-                // but strtol will read it as a two byte hex value
-                char temp_save;
-
-                //strtol returns a long
-                long value;
-
-                // \0NNN octal number
-            case '0':
-                //Save a char and replace it with \0
-                temp_save = temp[5];
-                temp[5] = '\0';
-
-                //Convert the value
-                value = strtol (temp + 2, &rest_of_string, 8);
-
-                //Check that it's valid
-                if (!value && rest_of_string == temp + 2)
-                {
-                    fprintf (stderr, "Invalid escape code: %s\n", temp);
-                    exit (EXIT_FAILURE);
-                }
-
-                //Assign the value
-                *temp = (char) value;
-
-                //Restore saved char
-                temp[5] = temp_save;
-
-                //Recalculate string length
-                string_length -= rest_of_string - temp;
-                string_length += 2;     //Correction
-                break;
-
-                // \xNN hex number
-            case 'x':
-                //Save a char and replace it with \0
-                temp_save = temp[4];
-                temp[4] = '\0';
-
-                //Convert the value
-                value = strtol (temp + 2, &rest_of_string, 16);
-
-                //Check that it's valid
-                if (!value && rest_of_string == temp + 2)
-                {
-                    fprintf (stderr, "Invalid escape code: %s\n", temp);
-                    exit (EXIT_FAILURE);
-                }
-
-                //Assign the value
-                *temp = (char) value;
-
-                //Restore saved char
-                temp[4] = temp_save;
-
-                //Recalculate string length
-                string_length -= rest_of_string - temp;
-                string_length += 2;     //Correction
-                break;
-
-            /** Invalid escape code */
-            default:
-                *(temp + 2) = '\0';
-                fprintf (stderr, "Invalid escape code: %s\n", temp);
-                exit (EXIT_FAILURE);
-            }
-
-        /** Move the rest of the string down */
-            //Move temp past the escaped char
-            // Otherwise a \\ might create a new escape by accident
-            temp++;
+        //Byte values are turned into bytes instead
+        // and are never followed by a newline
+        string_length = parse_bytes (string);
+        newline = false;
+    }
+    else if (escapes)
+    {
+        //After \c there is no newline either
+        bool stop = false;
 
-            //Copy rest of string down
-            // We cannot use str* functions since source and dest overlap
-            int i;
-            for (i = 0; rest_of_string[i] != '\0'; i++)
-                temp[i] = rest_of_string[i];
+        string_length = interpret_escapes (string, &stop);
 
-            // Terminate temp
-            temp[i] = '\0';
-        }
+        if (stop)
+            newline = false;
     }
 
 
-
   /** Correct string ending for printing */
     if (newline)
     {
@@ -350,16 +585,13 @@ int main (int argc, char *argv[])
     }
 
   /** Print the string */
-    //Use fwrite(), it's faster
-    if (fwrite (string, string_length, 1, stdout) != 1)
-    {
-        fprintf (stderr, "Standard output error");
-        exit (EXIT_FAILURE);;
-    }
+    write_block (string, string_length);
 
   /** Free up string */
     free (string);
 
+    stats_report ();
+
   /** All done, exiting */
     return EXIT_SUCCESS;
 }
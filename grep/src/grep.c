@@ -10,7 +10,22 @@
  *
  * Options recognized are:
  * -h show help
- * -e Do case insensitive search
+ * -i Do case insensitive search
+ * -w only match whole words
+ * -x only match whole lines
+ * -m N stop after N matching lines
+ * -a search binary files as text
+ * -I skip binary files
+ * -R read LZ4 files as they are, don't decompress them
+ * -u print lines at once, unbuffered
+ * -S show I/O statistics
+ * -j N search with N threads (host build only)
+ *
+ * Files with a NUL in their first block are binary. For those only
+ * "Binary file name matches" is printed, at the first match.
+ * With more than one file, matching lines start with the filename.
+ * An LZ4 file that can't be decompressed is reported, and the search
+ * goes on with the next file.
  *
  */
 #include <ctype.h>
@@ -19,9 +34,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "blockio.h"
+#include "output.h"
+#include "parallel.h"
+#include "stats.h"
+
 /**
  * Maximum lenght of one line
  *
+ * Longer lines are searched in pieces this long
  */
 #ifndef LINEMAX
 #define LINEMAX 16384
@@ -33,98 +54,483 @@
  */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s [-hi] pattern filename\r\n", prog_name);
+    printf ("Usage: %s [-hiwxaIRuS] [-m N] pattern filename...\r\n",
+            prog_name);
     printf ("-h show this help message\r\n");
     printf ("-i case insensitive matching\r\n");
+    printf ("-w only match whole words\r\n");
+    printf ("-x only match whole lines\r\n");
+    printf ("-m N stop after N matching lines\r\n");
+    printf ("-a search binary files as text\r\n");
+    printf ("-I skip binary files\r\n");
+    printf ("-R read LZ4 files as they are, don't decompress\r\n");
+    printf ("-u print output at once, unbuffered\r\n");
+    printf ("-S show I/O statistics\r\n");
+#ifdef HOST_BUILD
+    printf ("-j N search with N threads\r\n");
+#endif
 }
 
 /**
- * Search for a substring in a string
- * case insensitive
+ * Search tables
+ *
+ * The search is a Boyer-Moore-Horspool "skip search".
+ * Instead of trying every position in a line, it looks at the character
+ * under the end of the pattern. If that character is not in the pattern
+ * at all, the pattern can skip ahead its entire length.
+ *
+ * Case insensitive search is done by folding every character through
+ * the fold table, which maps a character to itself or to lower case.
+ *
+ * Whole word (-w) and whole line (-x) matches are checked where the
+ * pattern was found, no second search is needed.
  *
  */
-const char *strcasestr (const char *haystack, const char *needle)
+//How far to skip for each character
+size_t skip[256];
+
+//Character folding, to lower case or to itself
+unsigned char fold[256];
+
+//The pattern, folded
+unsigned char *folded_pattern;
+size_t pattern_length;
+
+//Characters words are made of, letters, digits and '_'
+bool word_char[256];
+
+//Only match whole words, or whole lines?
+bool whole_word = false;
+bool whole_line = false;
+
+/**
+ * Which ends of the text searched are ends of the line
+ *
+ * Lines longer than LINEMAX are searched in pieces. Where a piece
+ * ends in the middle of a line there is no line end and no word end,
+ * the line goes on in the next piece.
+ *
+ */
+#define LINE_START 1
+#define LINE_END 2
+
+/**
+ * Set up the search tables for pattern
+ *
+ */
+void setup_search (char *pattern, bool insensitive)
 {
+    pattern_length = strlen (pattern);
 
-  /** Check valid inputs */
-    if (haystack == NULL || needle == NULL)
+  /** Fold and word tables */
+    for (int ch = 0; ch < 256; ch++)
     {
-        return NULL;
+        fold[ch] = insensitive ? tolower (ch) : ch;
+        word_char[ch] = isalnum (ch) || ch == '_';
     }
 
-  /** Searching for an empty string ? */
-    if (*needle == '\0')
+  /** Folded pattern */
+    if ((folded_pattern = malloc (pattern_length + 1)) == NULL)
+    {
+        fprintf (stderr, "Out of memory\n");
+        exit (EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i <= pattern_length; i++)
+        folded_pattern[i] = fold[(unsigned char) pattern[i]];
+
+  /** Skip table */
+    //Characters not in the pattern skip the whole pattern
+    for (int ch = 0; ch < 256; ch++)
+        skip[ch] = pattern_length;
+
+    //Characters in the pattern skip to line up with their last
+    // occurence in it (not counting the last character of the pattern)
+    for (size_t i = 0; i + 1 < pattern_length; i++)
+        skip[folded_pattern[i]] = pattern_length - 1 - i;
+}
+
+/**
+ * Is the pattern, found at here in text, a whole word?
+ *
+ * The characters on either side of it must not be part of a word.
+ * At an end of text that is not an end of the line (see LINE_START)
+ * what is on the other side isn't known, so it isn't a whole word.
+ *
+ */
+bool is_whole_word (const char *text, size_t length, const char *here,
+                    int ends)
+{
+    const char *after = here + pattern_length;
+
+    return (here == text ? (ends & LINE_START) != 0
+            : !word_char[(unsigned char) here[-1]])
+        && (after == text + length ? (ends & LINE_END) != 0
+            : !word_char[(unsigned char) *after]);
+}
+
+/**
+ * Character as the search sees it
+ *
+ * Case sensitive searches look at characters as they are, case
+ * insensitive ones fold them through the fold table first
+ *
+ */
+#define AS_IS(ch) (ch)
+#define FOLDED(ch) fold[ch]
+
+/**
+ * Search for the pattern in length characters of text
+ *
+ * text does not have to be '\0' terminated, ends says which of its
+ * ends are ends of the line (LINE_START, LINE_END)
+ *
+ * Returns where the pattern starts in text or NULL if it isn't there
+ *
+ * The search is written once, as a macro, and made into a function for
+ * each way of looking at characters (CHAR is AS_IS or FOLDED above).
+ * A case sensitive search then doesn't pay for a table lookup on every
+ * character it looks at.
+ *
+ */
+#define SKIP_SEARCH(name, CHAR) \
+const char *name (const char *text, size_t length, int ends) \
+{ \
+ \
+  /** Whole lines only? */ \
+    /* Then the line, without its line ending, has to be as */ \
+    /* long as the pattern and it can only be in one place. */ \
+    /* A piece of a longer line never is */ \
+    if (whole_line) \
+    { \
+        if (ends != (LINE_START | LINE_END)) \
+            return NULL; \
+ \
+        if (length != 0 && text[length - 1] == '\n') \
+            length--; \
+ \
+        if (length != 0 && text[length - 1] == '\r') \
+            length--; \
+ \
+        if (length != pattern_length) \
+            return NULL; \
+    } \
+ \
+    /* Empty pattern matches everything */ \
+    if (pattern_length == 0) \
+        return text; \
+ \
+    /* Can the pattern fit at all? */ \
+    if (length < pattern_length) \
+        return NULL; \
+ \
+    /* Last character of the pattern */ \
+    size_t last = pattern_length - 1; \
+    unsigned char last_char = folded_pattern[last]; \
+ \
+    /* Where the pattern is tried */ \
+    const char *here = text; \
+    const char *end = text + length - pattern_length; \
+ \
+    while (here <= end) \
+    { \
+        /* Character under the end of the pattern */ \
+        unsigned char ch = CHAR ((unsigned char) here[last]); \
+ \
+      /** Possible match, check the rest going backwards */ \
+        if (ch == last_char) \
+        { \
+            size_t i = last; \
+ \
+            while (i > 0 \
+                   && CHAR ((unsigned char) here[i - 1]) == \
+                   folded_pattern[i - 1]) \
+                i--; \
+ \
+            /* Found it, but is it a whole word? */ \
+            if (i == 0 && (!whole_word \
+                           || is_whole_word (text, length, here, ends))) \
+                return here; \
+        } \
+ \
+      /** Skip ahead */ \
+        here += skip[ch]; \
+    } \
+ \
+    return NULL; \
+}
+
+SKIP_SEARCH (skip_search_exact, AS_IS)
+SKIP_SEARCH (skip_search_folded, FOLDED)
+
+/**
+ * The search to use
+ *
+ * Picked once in main(), depending on -i
+ *
+ */
+const char *(*skip_search) (const char *text, size_t length, int ends);
+
+/**
+ * Output and settings shared by all files
+ *
+ */
+//Matching lines are collected and written in large blocks
+block_writer out;
+
+//Name printed in front of matching lines, NULL for none
+// Names are printed when there is more than one file
+char *prefix_name = NULL;
+
+//Most matching lines to print per file (-m), 0 for all
+unsigned long max_count = 0;
+
+//Binary files: search them as text (-a), or skip them (-I)?
+bool binary_as_text = false;
+bool skip_binary = false;
+
+//Read LZ4 files as they are (-R)?
+bool read_raw = false;
+
+//For the statistics
+unsigned long scanned = 0;
+unsigned long matched = 0;
+unsigned long binary_files = 0;
+
+/**
+ * Print a matching line
+ *
+ */
+void print_line (const char *line, size_t length, bool complete)
+{
+    if (prefix_name != NULL)
     {
-        //Yup
-        //Empty sring matches everything
-        return haystack;
+        block_writer_puts (out, prefix_name);
+        block_writer_write (out, ":", 1);
     }
 
-  /** Serach for needle in haystack */
-    //Do one search for needle for every character in haystack
-    for (; *haystack; haystack++)
+    block_writer_write (out, line, length);
+
+    //The last line may not end in a newline, add one
+    if (complete && line[length - 1] != '\n')
+        block_writer_write (out, "\n", 1);
+}
+
+/**
+ * Is the file binary?
+ *
+ * Text files don't have NULs in them, binaries almost always do.
+ * Only the first block is looked at, it is read anyway.
+ *
+ */
+bool is_binary (block_reader reader)
+{
+    char *block;
+    size_t length = block_reader_peek (reader, &block);
+
+    return memchr (block, '\0', length) != NULL;
+}
+
+#ifdef HOST_BUILD
+/**
+ * Matching lines of one chunk, for -j
+ *
+ * They are collected in memory and printed once all chunks
+ * before this one have been printed
+ *
+ */
+struct chunk_matches
+{
+    char *lines;
+    size_t length;
+    size_t size;
+
+    unsigned long scanned;
+    unsigned long matched;
+};
+
+//Threads to search with, -j
+int jobs = 1;
+
+/**
+ * Add length bytes of text to the matches of a chunk
+ *
+ */
+void add_match (struct chunk_matches *matches, const char *text,
+                size_t length)
+{
+    if (matches->length + length > matches->size)
     {
-        //Search variables
-        const char *h = haystack;
-        const char *n = needle;
+        matches->size = (matches->length + length) * 2;
 
-    /** Compare each character in a case-insensitive manner */
-        while (*h && *n
-               && (tolower ((unsigned char) *h) ==
-                   tolower ((unsigned char) *n)))
+        if ((matches->lines = realloc (matches->lines, matches->size)) == NULL)
         {
-            h++;
-            n++;
+            fprintf (stderr, "Out of memory\n");
+            exit (EXIT_FAILURE);
         }
+    }
+
+    memcpy (matches->lines + matches->length, text, length);
+    matches->length += length;
+}
 
-    /** Match found ? */
-        //If we are at the end of needle, a match was found
-        if (!*n)
+/**
+ * Look for matching lines in a chunk, on a thread of its own
+ *
+ * The chunk holds whole lines only
+ *
+ */
+void match_chunk (const char *chunk, size_t length, void *result)
+{
+    struct chunk_matches *matches = result;
+    const char *end = chunk + length;
+
+    while (chunk < end)
+    {
+        //Find the end of the line
+        const char *newline = memchr (chunk, '\n', end - chunk);
+        size_t line_length = newline != NULL ?
+            (size_t) (newline - chunk + 1) : (size_t) (end - chunk);
+
+        matches->scanned++;
+
+        if (skip_search (chunk, line_length, LINE_START | LINE_END) != NULL)
         {
-            // Match found
-            return haystack;
+            if (prefix_name != NULL)
+            {
+                add_match (matches, prefix_name, strlen (prefix_name));
+                add_match (matches, ":", 1);
+            }
+
+            add_match (matches, chunk, line_length);
+            matches->matched++;
+
+            //The last line may not end in a newline, add one
+            if (newline == NULL)
+                add_match (matches, "\n", 1);
         }
+
+        chunk += line_length;
     }
+}
+
+/**
+ * Print the matching lines of a chunk
+ *
+ */
+void merge_matches (void *result)
+{
+    struct chunk_matches *matches = result;
 
-    // No match found
-    return NULL;
+    block_writer_write (out, matches->lines, matches->length);
+    free (matches->lines);
+
+    scanned += matches->scanned;
+    matched += matches->matched;
 }
+#endif
 
 /**
- * Go over a file and print lines that matches pattern
- * Case insensitive if insensitive is true
+ * Print the lines the reader hands out that match the pattern
+ *
+ * name is used for binary files, which only get one line saying
+ * they match
  *
  */
-void match_pattern (bool insensitive, char *pattern, FILE * file)
+void scan_lines (block_reader reader, char *name, bool binary)
 {
-    //Storage for lines read
-    char line[LINEMAX];
+    //The line
+    char *line;
+    size_t length;
+    bool complete;
+
+    //Matching lines in this file
+    unsigned long file_matches = 0;
+
+    //Does the next piece start a line? Not after a piece of a long line
+    int starts_line = LINE_START;
 
   /** Get all lines and look for matches */
-    while (fgets (line, sizeof (line), file) != NULL)
+    while ((length = block_reader_line (reader, &line, &complete)) != 0)
     {
-        bool match_found;
+        int ends = starts_line | (complete ? LINE_END : 0);
 
+        scanned++;
+        starts_line = complete ? LINE_START : 0;
 
-      /** Case insensitive search ?*/
-        if (insensitive)
-        {
-            //Look for pattern ignoring case
-            match_found = (strcasestr (line, pattern) != NULL);
-        }
-        else
+      /** Match found ? */
+        if (skip_search (line, length, ends) != NULL)
         {
-            //Look for pattern
-            match_found = (strstr (line, pattern) != NULL);
+            matched++;
+
+            //Binary files are not printed, one match is enough
+            if (binary)
+            {
+                block_writer_puts (out, "Binary file ");
+                block_writer_puts (out, name);
+                block_writer_puts (out, " matches\n");
+                break;
+            }
+
+            print_line (line, length, complete);
+
+            //Enough? Then stop reading
+            if (++file_matches == max_count)
+                break;
         }
+    }
+}
 
-      /** Match found ? */
-        if (match_found)
+/**
+ * Go over a file and print lines that match the pattern
+ *
+ * name is used for binary files and errors
+ *
+ * Returns false if the file could not all be read
+ *
+ */
+bool match_pattern (FILE * file, char *name)
+{
+    //Lines are read straight out of the reader's buffer
+    block_reader reader = read_raw ? block_reader_open_raw (file, LINEMAX)
+        : block_reader_open (file, LINEMAX);
+
+  /** Binary file? */
+    bool binary = !binary_as_text && is_binary (reader);
+
+    if (binary)
+    {
+        binary_files++;
+
+        if (skip_binary)
         {
-            //Print line
-            printf ("%s", line);
+            block_reader_close (reader);
+            return true;
         }
     }
+
+  /** Search in chunks on jobs threads, if asked for and possible */
+    // Not with -m, that stops at the first matches, otherwise
+    // line by line
+#ifdef HOST_BUILD
+    if (binary || max_count != 0 || jobs <= 1
+        || !parallel_scan (file, jobs, true, sizeof (struct chunk_matches),
+                           match_chunk, merge_matches))
+#endif
+        scan_lines (reader, name, binary);
+
+  /** Compressed file that ended early? */
+    const char *error = block_reader_error (reader);
+
+    if (error != NULL)
+    {
+        block_writer_flush (out);
+        fprintf (stderr, "%s: %s\n", name, error);
+    }
+
+    block_reader_close (reader);
+
+    return error == NULL;
 }
 
 
@@ -138,7 +544,11 @@ int main (int argc, char *argv[])
     FILE *file;
     bool insensitive = false;
     char *pattern = NULL;
-    char *filename = NULL;
+    int status = EXIT_SUCCESS;
+
+    //The files are the arguments after the pattern
+    int first_file = 0;
+    int files = 0;
 
   /** Argument processing */
     for (int i = 1; i != argc; i++)
@@ -157,22 +567,80 @@ int main (int argc, char *argv[])
             insensitive = true;
         }
 
+      /** User wants whole words or whole lines only */
+        else if (strcmp (argv[i], "-w") == 0)
+        {
+            whole_word = true;
+        }
+        else if (strcmp (argv[i], "-x") == 0)
+        {
+            whole_line = true;
+        }
+
+      /** User wants at most N matching lines */
+        else if (strcmp (argv[i], "-m") == 0 && i + 1 != argc)
+        {
+            long parsed_count = atol (argv[++i]);
+
+            if (parsed_count <= 0)
+            {
+                fprintf (stderr, "The max count must be positive");
+
+                return EXIT_FAILURE;
+            }
+
+            max_count = parsed_count;
+        }
+
+      /** User wants binary files searched as text */
+        else if (strcmp (argv[i], "-a") == 0)
+        {
+            binary_as_text = true;
+        }
+
+      /** User wants binary files skipped */
+        else if (strcmp (argv[i], "-I") == 0)
+        {
+            skip_binary = true;
+        }
+
+      /** User wants LZ4 files searched as they are */
+        else if (strcmp (argv[i], "-R") == 0)
+        {
+            read_raw = true;
+        }
+
+      /** User wants to see lines as they are found */
+        else if (strcmp (argv[i], "-u") == 0)
+        {
+            output_unbuffered ();
+        }
+
+      /** User wants I/O statistics */
+        else if (strcmp (argv[i], "-S") == 0)
+        {
+            stats_start ();
+        }
+#ifdef HOST_BUILD
+      /** User wants several threads */
+        else if (strcmp (argv[i], "-j") == 0 && i + 1 != argc)
+        {
+            jobs = atoi (argv[++i]);
+        }
+#endif
+
       /** Fist non option is pattern to search for */
         else if (!pattern)
         {
             pattern = argv[i];
         }
-      /** Second non option is filename */
-        else if (!filename)
-        {
-            filename = argv[i];
-        }
-      /** Too many arguments */
+      /** The rest are filenames */
+        // They have to come after all options
         else
         {
-            show_usage (argv[0]);
-
-            return EXIT_FAILURE;
+            first_file = i;
+            files = argc - i;
+            break;
         }
 
     }
@@ -185,26 +653,53 @@ int main (int argc, char *argv[])
         return EXIT_FAILURE;;
     }
 
-  /** Open text source */
-    if (filename == NULL)
+    setup_search (pattern, insensitive);
+    out = output_console ();
+
+    //Pick the search loop once, instead of folding every
+    // character when it isn't needed
+    skip_search = insensitive ? skip_search_folded : skip_search_exact;
+
+  /** Search the files */
+    if (files == 0)
     {
         //No filename means read from stdin
-        file = stdin;
+        if (!match_pattern (stdin, "(standard input)"))
+            status = EXIT_FAILURE;
     }
-    else if ((file = fopen (filename, "r")) == NULL)
+    else
     {
-        fprintf (stderr, "Error opening file");
-        return EXIT_FAILURE;
-    }
+        for (int i = first_file; i != argc; i++)
+        {
+            if ((file = fopen (argv[i], "r")) == NULL)
+            {
+                //Go on with the other files
+                block_writer_flush (out);
+                fprintf (stderr, "Error opening file %s\n", argv[i]);
+                status = EXIT_FAILURE;
+                continue;
+            }
 
+            //With more than one file, say which file a line is from
+            if (files > 1)
+                prefix_name = argv[i];
 
-  /** Search file for patterns */
-    match_pattern (insensitive, pattern, file);
+            if (!match_pattern (file, argv[i]))
+                status = EXIT_FAILURE;
 
+            fclose (file);
+        }
+    }
 
     //Finish up
-    fclose (file);
+    block_writer_close (out);
+    free (folded_pattern);
+
+    stats_extra ("lines scanned", scanned);
+    stats_extra ("lines matched", matched);
+    stats_extra ("binary files", binary_files);
+    stats_report ();
 
   /** All done, exiting */
-    return EXIT_SUCCESS;
+    return status;
 }
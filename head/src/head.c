@@ -1,24 +1,90 @@
+/**
+ * head for Agon Light
+ *
+ * Show the N first lines in a textfile
+ *
+ * Original by Vasco Costa
+ * Modifications by E.M. From
+ *
+ * Lines are read with the block reader, straight out of its buffer,
+ * and written with the block writer. Lines longer than the buffer
+ * are passed on in pieces, only complete lines are counted.
+ *
+ * With -r A,B lines A to B are shown instead of the first lines.
+ * With -I the line index next to the file (see lineidx.h) is used to
+ * get close to line A without reading all lines before it.
+ *
+ */
+
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "blockio.h"
+#include "lineidx.h"
+#include "output.h"
+#include "stats.h"
+
+/**
+ * Helper function to print a help message
+ *
+ */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s [-hn] filename\r\n", prog_name);
+    printf ("Usage: %s [-hnrIuS] filename\r\n", prog_name);
     printf ("-h show this help message\r\n");
-    printf ("-l print the first n lines (default: 10)\r\n");
+    printf ("-n print the first n lines (default: 10)\r\n");
+    printf ("-r A,B print lines A to B\r\n");
+    printf ("-I use a line index, made if needed\r\n");
+    printf ("-u print output at once, unbuffered\r\n");
+    printf ("-S show I/O statistics\r\n");
 }
 
-void show_lines (FILE * file, int lines)
+/**
+ * Display N lines from file, after skipping some
+ *
+ * Returns why a compressed file ended early, NULL if it didn't
+ *
+ */
+const char *show_lines (FILE * file, unsigned long skip, unsigned long lines)
 {
-    char buf[1024];
-    int lc = 0;
-
-    while (fgets (buf, sizeof (buf), file) != NULL && lc < lines)
+    block_reader reader = block_reader_open (file, 0);
+    block_writer out = output_console ();
+
+    //The line
+    char *line;
+    size_t length;
+    bool complete;
+
+    //Lines printed so far
+    unsigned long lc = 0;
+
+  /** Skip lines before the ones to print */
+    while (skip > 0
+           && (length = block_reader_line (reader, &line, &complete)) != 0)
+        if (complete)
+            skip--;
+
+  /** Print */
+    while (lc < lines
+           && (length = block_reader_line (reader, &line, &complete)) != 0)
     {
-        printf ("%s", buf);
-        lc++;
+        block_writer_write (out, line, length);
+
+        //Only count lines, not pieces of lines
+        if (complete)
+            lc++;
     }
+
+    const char *error = block_reader_error (reader);
+
+    block_writer_close (out);
+    block_reader_close (reader);
+
+    stats_extra ("lines printed", lc);
+
+    return error;
 }
 
 int main (int argc, char *argv[])
@@ -28,6 +94,13 @@ int main (int argc, char *argv[])
     int parsed_lines = 0;
     size_t lines = 10;
 
+    //First line to print, from 0
+    unsigned long first = 0;
+
+    //Use the line index?
+    bool use_index = false;
+    line_index index;
+
     for (int i = 1; i != argc; i++)
     {
         if (strcmp (argv[i], "-h") == 0)
@@ -49,6 +122,35 @@ int main (int argc, char *argv[])
 
             lines = parsed_lines;
         }
+        else if (strcmp (argv[i], "-r") == 0 && i + 1 != argc)
+        {
+            //Lines A to B, counted from 1
+            char *comma;
+            long from = strtol (argv[++i], &comma, 10);
+            long to = *comma == ',' ? strtol (comma + 1, NULL, 10) : 0;
+
+            if (from <= 0 || to < from)
+            {
+                fprintf (stderr, "The range must be A,B with 0 < A <= B");
+
+                return 1;
+            }
+
+            first = from - 1;
+            lines = to - from + 1;
+        }
+        else if (strcmp (argv[i], "-I") == 0)
+        {
+            use_index = true;
+        }
+        else if (strcmp (argv[i], "-u") == 0)
+        {
+            output_unbuffered ();
+        }
+        else if (strcmp (argv[i], "-S") == 0)
+        {
+            stats_start ();
+        }
         else if (!filename)
         {
             filename = argv[i];
@@ -75,8 +177,27 @@ int main (int argc, char *argv[])
         return 1;
     }
 
-    show_lines (file, lines);
+    //Get close to the first line with the index
+    unsigned long at = 0;
+
+    if (use_index && first > 0
+        && (index = line_index_open (file, filename)) != NULL)
+    {
+        at = line_index_seek (index, file, first);
+        line_index_close (index);
+    }
+
+    const char *error = show_lines (file, first - at, lines);
+
     fclose (file);
+    stats_report ();
+
+    if (error != NULL)
+    {
+        fprintf (stderr, "%s: %s\n", filename, error);
+
+        return 1;
+    }
 
     return 0;
 }
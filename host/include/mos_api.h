@@ -0,0 +1,23 @@
+/**
+ * Stand-in for AgDev's mos_api.h in host builds
+ *
+ * By E.M. From
+ *
+ * Only what the utilities use is declared. Bytes that would have gone
+ * to the VDP are written to stdout instead, so what a utility sends
+ * can be checked with od or a diff.
+ *
+ */
+
+#ifndef HOST_MOS_API_H
+#define HOST_MOS_API_H
+
+/**
+ * Send a block of bytes to the VDP in one go
+ *
+ * size bytes, or if size is 0, up to the delimiter.
+ * Returns the number of bytes sent
+ */
+unsigned int mos_puts (char *buffer, unsigned int size, char delimiter);
+
+#endif
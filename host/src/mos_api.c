@@ -0,0 +1,26 @@
+/**
+ * Stand-in for AgDev's MOS API functions in host builds
+ *
+ * By E.M. From
+ *
+ * See host/include/mos_api.h
+ *
+ */
+
+#include <stdio.h>
+
+#include "mos_api.h"
+
+unsigned int mos_puts (char *buffer, unsigned int size, char delimiter)
+{
+    //No size, send up to the delimiter
+    if (size == 0)
+        while (buffer[size] != delimiter)
+            size++;
+
+    //Straight out, like the VDP would show it
+    fwrite (buffer, 1, size, stdout);
+    fflush (stdout);
+
+    return size;
+}
@@ -1,12 +1,103 @@
 /** Keyboard layout changer for Agon Light
  *
  * By E.M. From
+ *
+ * The settings asked for are put together as VDU bytes in a buffer and
+ * sent to the VDP in one go. The same bytes can be written to a file,
+ * which a boot script sends to the VDP again with TYPE, so the layout
+ * is back after a reboot without running keyb or parsing anything.
+ *
+ * Options recognized are:
+ * -h show help
+ * -k DELAY,RATE,LEDS keyboard repeat delay, repeat rate and LEDs
+ * -w FILE also write the VDU bytes to FILE
+ * -n don't send anything to the VDP (with -w)
+ *
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <agon/vdp_vdu.h>
+#include <mos_api.h>
+
+/**
+ * The layouts
+ *
+ * In order of their number, the locale the VDP knows them by
+ *
+ */
+struct layout
+{
+    const char *name;
+    const char *description;
+};
+
+const struct layout layouts[] = {
+    {"UK", "United Kingdom"},
+    {"US", "USA"},
+    {"DE", "German"},
+    {"IT", "Italian"},
+    {"ES", "Spanish"},
+    {"FR", "French"},
+    {"BE", "Belgian"},
+    {"NO", "Norwegian"},
+    {"JP", "Japanese"},
+    {"USI", "US International"},
+    {"USA", "US International Alternate"},
+    {"CHD", "Swiss German"},
+    {"CHF", "Swiss French"},
+    {"DK", "Danish"},
+    {"SV", "Swedish"},
+    {"PT", "Portuguese"},
+    {"BR", "Brazilian Portuguese"},
+    {"DV", "Dvorak"},
+};
+
+/** Number of layouts currenty supported */
+const int number_of_layouts = sizeof (layouts) / sizeof (layouts[0]);
+
+/**
+ * The layout numbers sorted by name
+ *
+ * So a name can be found with a binary search, a handful of
+ * compares instead of one for every layout.
+ * Has to be kept in strcmp() order when layouts are added!
+ *
+ */
+const unsigned char layouts_by_name[] = {
+    6,                          //BE
+    16,                         //BR
+    11,                         //CHD
+    12,                         //CHF
+    2,                          //DE
+    13,                         //DK
+    17,                         //DV
+    4,                          //ES
+    5,                          //FR
+    3,                          //IT
+    8,                          //JP
+    7,                          //NO
+    15,                         //PT
+    14,                         //SV
+    0,                          //UK
+    1,                          //US
+    10,                         //USA
+    9,                          //USI
+};
+
+/**
+ * Most VDU bytes one run of keyb sends
+ *
+ */
+#define VDU_MAX 32
+
+/**
+ * VDU bytes to send
+ *
+ */
+char vdu[VDU_MAX];
+int vdu_length = 0;
 
 /**
  * Helper function to print a help message
@@ -14,108 +105,269 @@
  */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s layout\n\n", prog_name);
+    printf ("Usage: %s [-hn] [-k delay,rate,leds] [-w file] [layout]\n\n",
+            prog_name);
+    printf ("-h show this help message\n");
+    printf ("-k set keyboard repeat delay (250-1000 ms), rate (33-500 ms)\n");
+    printf ("   and LEDs (0-255)\n");
+    printf ("-w also write the settings to file, TYPE it to set them\n");
+    printf ("-n only write the file, don't set anything now\n\n");
     printf ("Where layout is one of:\n");
-    printf ("0     UK     United Kingdom\n");
-    printf ("1     US     USA\n");
-    printf ("2     DE     German\n");
-    printf ("3     IT     Italian\n");
-    printf ("4     ES     Spanish\n");
-    printf ("5     FR     French\n");
-    printf ("6     BE     Belgian\n");
-    printf ("7     NO     Norwegian\n");
-    printf ("8     JP     Japanese\n");
-    printf ("9     USI    US International\n");
-    printf ("10    USA    US International Alternate\n");
-    printf ("11    CHD    Swiss German\n");
-    printf ("12    CHF    Swiss French\n");
-    printf ("13    DK     Danish\n");
-    printf ("14    SV     Swedish\n");
-    printf ("15    PT     Portuguese\n");
-    printf ("16    BR     Brazilian Portuguese\n");
-    printf ("17    DV     Dvorak\n");
+
+    for (int i = 0; i < number_of_layouts; i++)
+        printf ("%-5d %-6s %s\n", i, layouts[i].name, layouts[i].description);
 }
 
 /**
- * Short names of the layouts
- *
- */
-const char *layout_names[] = {
-    "UK",
-    "US",
-    "DE",
-    "IT",
-    "ES",
-    "FR",
-    "BE",
-    "NO",
-    "JP",
-    "USI",
-    "USA",
-    "CHD",
-    "CHF",
-    "DK",
-    "SV",
-    "PT",
-    "BR",
-    "DV"
-};
+ * Helper function to exit with an error message
+ *
+ */
+void exit_with_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
 
-/** Number of layouts currenty supported */
-const int number_of_layouts = 18;
+/**
+ * Read a decimal number from the start of text
+ *
+ * Stops at the first character that isn't a digit, end is set to
+ * point at it (if end isn't NULL)
+ *
+ * Returns -1 if there are no digits or the number is more than max
+ *
+ */
+long parse_number (const char *text, long max, const char **end)
+{
+    long value = 0;
+    const char *ch = text;
+
+    for (; *ch >= '0' && *ch <= '9'; ch++)
+        if ((value = value * 10 + (*ch - '0')) > max)
+            return -1;
+
+    if (end != NULL)
+        *end = ch;
+
+    return ch == text ? -1 : value;
+}
 
 /**
- * main() using arguments
- * Extended argument processing (AgDev) is not used
- * 
+ * Find a layout by number or by short name
+ *
+ * Returns its number, -1 if there is none
+ *
  */
-int main (int argc, char *argv[])
+int find_layout (const char *argument)
 {
+    const char *end;
+    long number;
 
-    //Check if we have an argument
-    if (argc != 2)
+  /** A number is used as it is */
+    number = parse_number (argument, number_of_layouts - 1, &end);
+
+    if (number != -1 && *end == '\0')
+        return number;
+
+  /** Binary search for the name */
+    // low and high are the part of layouts_by_name it can still be in
+    int low = 0;
+    int high = number_of_layouts - 1;
+
+    while (low <= high)
     {
-        show_usage (argv[0]);
-        return EXIT_SUCCESS;
+        int middle = (low + high) / 2;
+        int locale = layouts_by_name[middle];
+        int compared = strcmp (argument, layouts[locale].name);
+
+        if (compared == 0)
+            return locale;
+
+        if (compared < 0)
+            high = middle - 1;
+        else
+            low = middle + 1;
     }
 
+    return -1;
+}
+
+/**
+ * Add bytes to the VDU bytes to send
+ *
+ */
+void vdu_add (const char *bytes, int length)
+{
+    if (vdu_length + length > VDU_MAX)
+        exit_with_error ("Too many settings");
+
+    memcpy (vdu + vdu_length, bytes, length);
+    vdu_length += length;
+}
+
+/**
+ * VDU 23, 0, &81, locale
+ *
+ * Set the keyboard layout
+ *
+ */
+void vdu_keyboard_locale (int locale)
+{
+    char bytes[] = { 23, 0, (char) 0x81, locale };
+
+    vdu_add (bytes, sizeof (bytes));
+}
+
+/**
+ * VDU 23, 0, &88, delay; rate; leds
+ *
+ * Set keyboard repeat and LEDs. delay and rate are 16 bit,
+ * lowest byte first (the ; in VDU)
+ *
+ */
+void vdu_keyboard_control (int delay, int rate, int leds)
+{
+    char bytes[] = {
+        23, 0, (char) 0x88,
+        delay & 0xff, delay >> 8,
+        rate & 0xff, rate >> 8,
+        leds
+    };
+
+    vdu_add (bytes, sizeof (bytes));
+}
+
+/**
+ * What the VDP takes for -k
+ *
+ * It ignores a delay or rate outside these, so they are not sent
+ *
+ */
+#define DELAY_MIN 250
+#define DELAY_MAX 1000
+#define RATE_MIN 33
+#define RATE_MAX 500
+
+/**
+ * Parse -k delay,rate,leds and add it to the VDU bytes
+ *
+ */
+void parse_keyboard_control (const char *argument)
+{
+    const char *end;
+    long delay, rate, leds;
+
+    delay = parse_number (argument, 0xffff, &end);
+
+    if (delay == -1 || *end != ',')
+        exit_with_error ("Use -k delay,rate,leds");
+
+    rate = parse_number (end + 1, 0xffff, &end);
+
+    if (rate == -1 || *end != ',')
+        exit_with_error ("Use -k delay,rate,leds");
+
+    leds = parse_number (end + 1, 0xff, &end);
+
+    if (leds == -1 || *end != '\0')
+        exit_with_error ("Use -k delay,rate,leds");
+
+  /** Would the VDP take them? */
+    if (delay < DELAY_MIN || delay > DELAY_MAX)
+        exit_with_error ("The delay must be 250 to 1000 ms");
+
+    if (rate < RATE_MIN || rate > RATE_MAX)
+        exit_with_error ("The rate must be 33 to 500 ms");
+
+    vdu_keyboard_control (delay, rate, leds);
+}
+
+/**
+ * Write the VDU bytes to a file
+ *
+ */
+void write_settings (const char *filename)
+{
+    FILE *file;
+
+    if (!(file = fopen (filename, "wb")))
+        exit_with_error ("Error creating file");
+
+    if ((vdu_length != 0 && 1 != fwrite (vdu, vdu_length, 1, file))
+        || fclose (file) != 0)
+        exit_with_error ("Error writing file");
+}
+
+/**
+ * main() using arguments
+ * Extended argument processing (AgDev) is not used
+ *
+ */
+int main (int argc, char *argv[])
+{
+    char *settings_file = NULL;
+    bool send = true;
+
     //Layout wanted (if we find one)
     int locale = -1;
 
   /** Parse arguments */
-    for (int i = 0; i < number_of_layouts; i++)
+    for (int i = 1; i != argc; i++)
     {
-        //First by short name
-        if (0 == strcmp (argv[1], layout_names[i]))
+        if (strcmp (argv[i], "-h") == 0)
         {
-            locale = i;
-            break;
+            show_usage (argv[0]);
+            return EXIT_SUCCESS;
         }
-
-        //Then by number
-        char number[3];
-        sprintf (number, "%d", i);
-
-        if (0 == strcmp (argv[1], number))
+        else if (strcmp (argv[i], "-k") == 0 && i + 1 != argc)
+        {
+            parse_keyboard_control (argv[++i]);
+        }
+        else if (strcmp (argv[i], "-w") == 0 && i + 1 != argc)
+        {
+            settings_file = argv[++i];
+        }
+        else if (strcmp (argv[i], "-n") == 0)
+        {
+            send = false;
+        }
+        else if (locale == -1 && (locale = find_layout (argv[i])) != -1)
         {
-            locale = i;
-            break;
+            vdu_keyboard_locale (locale);
+        }
+        else
+        {
+            //Not a layout we know, exit with help
+            show_usage (argv[0]);
+            return EXIT_FAILURE;
         }
     }
 
-  /** Found a locale to set? */
-    if (locale == -1)
+  /** Not setting anything now and not writing it either? */
+    if (!send && settings_file == NULL)
     {
-        //Nope, exit with help
         show_usage (argv[0]);
         return EXIT_FAILURE;
     }
 
-  /** Set the locale */
-    vdp_set_keyboard_locale (locale);
+  /** Anything to set? */
+    if (vdu_length == 0)
+    {
+        show_usage (argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+  /** Write the settings for the boot script */
+    if (settings_file != NULL)
+        write_settings (settings_file);
+
+  /** Set everything in one go */
+    if (send)
+        mos_puts (vdu, vdu_length, 0);
 
   /** Report change in layout */
-    printf ("\nLayout set: %s\n", layout_names[locale]);
+    if (send && locale != -1)
+        printf ("\nLayout set: %s\n", layouts[locale].name);
 
     return EXIT_SUCCESS;
 }
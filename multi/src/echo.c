@@ -0,0 +1,11 @@
+/**
+ * echo for the multi-call binary
+ *
+ * Renames main() and show_usage(), which every utility has
+ *
+ */
+
+#define main echo_main
+#define show_usage echo_show_usage
+
+#include "../../echo/src/echo.c"
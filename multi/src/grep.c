@@ -0,0 +1,14 @@
+/**
+ * grep for the multi-call binary
+ *
+ * Renames main() and show_usage(), and the globals strings has too
+ *
+ */
+
+#define main grep_main
+#define show_usage grep_show_usage
+#define out grep_out
+#define prefix_name grep_prefix_name
+#define read_raw grep_read_raw
+
+#include "../../grep/src/grep.c"
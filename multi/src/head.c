@@ -0,0 +1,12 @@
+/**
+ * head for the multi-call binary
+ *
+ * Renames main() and show_usage(), and show_lines() which tail has too
+ *
+ */
+
+#define main head_main
+#define show_usage head_show_usage
+#define show_lines head_show_lines
+
+#include "../../head/src/head.c"
@@ -0,0 +1,142 @@
+/**
+ * Multi-call binary for Agon Light
+ *
+ * All the utilities in one binary
+ *
+ * By E.M. From
+ *
+ * Every utility is a MOSlet of its own, and every time one is run
+ * it has to be loaded from the sdcard, along with its own copy of
+ * printf, stdio and the shared code. This binary has all of them
+ * in it, so that code only exists once and everything is loaded
+ * in one go.
+ *
+ * Which utility to run is decided by
+ * - the name the binary was run as, e.g. a copy named grep.bin runs grep
+ * - otherwise the first argument, e.g. "multi grep -i foo file.txt"
+ *
+ * Every utility is compiled in as it is, by a file in this folder that
+ * renames its main() and whatever else another utility has the same
+ * name for, so they don't clash when linked together.
+ *
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The utilities, compiled in from the other files in this folder
+ *
+ */
+int echo_main (int argc, char *argv[]);
+int grep_main (int argc, char *argv[]);
+int head_main (int argc, char *argv[]);
+int pack_main (int argc, char *argv[]);
+int strings_main (int argc, char *argv[]);
+int tail_main (int argc, char *argv[]);
+int wc_main (int argc, char *argv[]);
+
+/**
+ * Name to utility table
+ *
+ */
+struct utility
+{
+    const char *name;
+    int (*main) (int argc, char *argv[]);
+};
+
+const struct utility utilities[] = {
+    {"echo", echo_main},
+    {"grep", grep_main},
+    {"head", head_main},
+    {"pack", pack_main},
+    {"strings", strings_main},
+    {"tail", tail_main},
+    {"wc", wc_main},
+};
+
+const int utility_count = sizeof (utilities) / sizeof (utilities[0]);
+
+/**
+ * Helper function to print a help message
+ *
+ */
+void show_usage (char *prog_name)
+{
+    printf ("Usage: %s utility [arguments]\r\n", prog_name);
+    printf ("Where utility is one of:\r\n");
+
+    for (int i = 0; i < utility_count; i++)
+        printf ("%s\r\n", utilities[i].name);
+}
+
+/**
+ * Find the utility called name
+ *
+ * name can be a path and have an extension, and case is ignored,
+ * since MOS doesn't care about case in filenames
+ *
+ * Returns NULL if there isn't one
+ *
+ */
+const struct utility *find_utility (const char *name)
+{
+    const char *start = name;
+
+  /** Skip the path */
+    for (const char *ch = name; *ch; ch++)
+        if (*ch == '/' || *ch == ':')
+            start = ch + 1;
+
+  /** Length without the extension */
+    size_t length = strcspn (start, ".");
+
+  /** Compare with every utility */
+    for (int i = 0; i < utility_count; i++)
+    {
+        const char *utility = utilities[i].name;
+        size_t j;
+
+        for (j = 0; j < length; j++)
+            if (tolower ((unsigned char) start[j]) != utility[j])
+                break;
+
+        if (j == length && utility[j] == '\0')
+            return &utilities[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * main() using arguments
+ * Extended argument processing (AgDev) is used
+ *
+ */
+int main (int argc, char *argv[])
+{
+    const struct utility *utility;
+
+  /** Run as one of the utilities? */
+    if ((utility = find_utility (argv[0])) != NULL)
+        return utility->main (argc, argv);
+
+  /** Utility given as first argument? */
+    if (argc < 2)
+    {
+        show_usage (argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    if ((utility = find_utility (argv[1])) == NULL)
+    {
+        show_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //The utility sees its own name as argv[0]
+    return utility->main (argc - 1, argv + 1);
+}
@@ -0,0 +1,13 @@
+/**
+ * pack for the multi-call binary
+ *
+ * Renames main() and show_usage(), and exit_with_error() which tail
+ * has too
+ *
+ */
+
+#define main pack_main
+#define show_usage pack_show_usage
+#define exit_with_error pack_exit_with_error
+
+#include "../../pack/src/pack.c"
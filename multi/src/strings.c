@@ -0,0 +1,14 @@
+/**
+ * strings for the multi-call binary
+ *
+ * Renames main() and show_usage(), and the globals grep has too
+ *
+ */
+
+#define main strings_main
+#define show_usage strings_show_usage
+#define out strings_out
+#define prefix_name strings_prefix_name
+#define read_raw strings_read_raw
+
+#include "../../strings/src/strings.c"
@@ -0,0 +1,13 @@
+/**
+ * tail for the multi-call binary
+ *
+ * Renames main() and show_usage(), and show_lines() which head has too.
+ * pack renames its exit_with_error(), so tail's can stay as it is.
+ *
+ */
+
+#define main tail_main
+#define show_usage tail_show_usage
+#define show_lines tail_show_lines
+
+#include "../../tail/src/tail.c"
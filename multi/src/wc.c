@@ -0,0 +1,11 @@
+/**
+ * wc for the multi-call binary
+ *
+ * Renames main() and show_usage(), which every utility has
+ *
+ */
+
+#define main wc_main
+#define show_usage wc_show_usage
+
+#include "../../wc/src/wc.c"
@@ -0,0 +1,519 @@
+/**
+ * pack for Agon Light
+ *
+ * Compress a file (usually a log) so the other utilities read it faster
+ *
+ * By E.M. From
+ *
+ * The block reader decompresses LZ4 files while it reads them (see
+ * lz4read.h), so grep, wc, head and strings take a packed log as it is.
+ *
+ * The file is written as an LZ4 frame, the same format the lz4 command
+ * on a PC writes and reads:
+ * - the frame header, with blocks of at most 64KB that don't depend
+ *   on each other and no checksums
+ * - the blocks, each one the size (4 bytes) and the compressed data,
+ *   or the data as it is if compressing did not make it smaller
+ * - four 0 bytes ending the frame
+ *
+ * Compressing is a greedy LZ77: at every position the hash of the next
+ * 4 bytes is looked up in a small table of where those bytes were seen
+ * last. If they are the same there, the match is made as long as it goes
+ * and written as a copy of earlier data. If not, the byte is a literal
+ * and the next position is tried. The table only remembers the last
+ * position for every hash, so some matches are missed, but it is only
+ * 8KB and every byte costs one lookup.
+ *
+ * After a long stretch without matches (binary data, most likely)
+ * positions are skipped a few at a time, so data that doesn't
+ * compress doesn't take long either.
+ *
+ * Options recognized are:
+ * -h show help
+ * -c write to stdout
+ * -d unpack instead
+ * -o FILE name of the file to write
+ * -S show I/O statistics
+ *
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockio.h"
+#include "stats.h"
+
+/**
+ * Size of the blocks the file is packed in
+ *
+ * 64KB is the largest the Agon can read back, and the largest
+ * block where every offset fits in the 2 bytes LZ4 has for it
+ */
+#define PACK_BLOCK (64L * 1024)
+
+/**
+ * Largest a block can get when it is packed
+ *
+ * Data that doesn't compress grows by a byte every 255 bytes,
+ * those blocks are stored as they are instead
+ */
+#define PACK_BOUND (PACK_BLOCK + PACK_BLOCK / 255 + 16)
+
+/**
+ * Size of the hash table, as bits of the hash
+ *
+ * 12 bits is 4096 positions, 8KB. More finds more matches
+ * but takes more memory
+ */
+#ifndef PACK_HASH_BITS
+#define PACK_HASH_BITS 12
+#endif
+
+#define PACK_HASH_SIZE (1 << PACK_HASH_BITS)
+
+/**
+ * Hash of the 4 bytes at p
+ *
+ * Only shifts and xors, the eZ80 has no fast multiply.
+ * Every byte changes some bits of the hash
+ */
+#define PACK_HASH(p) ((((p)[0] << 4) ^ ((p)[1] << 2) ^ (p)[2] \
+                       ^ ((p)[3] << 6)) & (PACK_HASH_SIZE - 1))
+
+/**
+ * Rules of the LZ4 block format
+ *
+ * A match is at least 4 bytes, the last 5 bytes of a block are
+ * always literals and the last match starts at least 12 bytes
+ * before the end of the block
+ */
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+
+/**
+ * Misses in a row before positions start being skipped
+ *
+ * Every 64 misses, one more position is skipped
+ */
+#define SKIP_AFTER_MISSES 6
+
+/**
+ * Start of an LZ4 frame with the settings used here
+ *
+ * The magic number 0x184D2204, then the frame descriptor:
+ * 0x60 version 1 and independent blocks, 0x40 blocks of at most 64KB.
+ * 0x82 is the checksum of the descriptor (part of its xxHash32), it
+ * is always the same since the descriptor is
+ */
+const char frame_header[] = { 0x04, 0x22, 0x4d, 0x18, 0x60, 0x40, (char) 0x82 };
+
+/**
+ * Where each hash was last seen, as a position in the block
+ *
+ * Not cleared between blocks, a position left over from the last
+ * block is either after where we are now (and skipped) or the
+ * 4 bytes there are compared anyway
+ */
+unsigned short hash_table[PACK_HASH_SIZE];
+
+//For the statistics
+unsigned long blocks_packed = 0;
+unsigned long blocks_stored = 0;
+
+/**
+ * Helper funcion to print a help message
+ *
+ */
+void show_usage (char *prog_name)
+{
+    printf ("Usage: %s [-hcdS] [-o output] filename\r\n", prog_name);
+    printf ("-h show this help message\r\n");
+    printf ("-c write to stdout\r\n");
+    printf ("-d unpack instead of pack\r\n");
+    printf ("-o name of the file to write\r\n");
+    printf ("   (default: filename.lz4, or without .lz4 with -d)\r\n");
+    printf ("-S show I/O statistics\r\n");
+}
+
+/**
+ * Helper function to exit with an error message
+ *
+ */
+void exit_with_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Write the part of a length that doesn't fit in the token
+ *
+ * As bytes of 255 and one byte with what is left, which can be 0
+ *
+ */
+unsigned char *pack_length (unsigned char *out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *out++ = 255;
+
+    *out++ = length;
+
+    return out;
+}
+
+/**
+ * Write one sequence: literals, then a match
+ *
+ * A match_length of 0 means there is no match, only the
+ * literals at the end of the block
+ *
+ */
+unsigned char *pack_sequence (unsigned char *out,
+                              const unsigned char *literals,
+                              size_t literal_length, size_t offset,
+                              size_t match_length)
+{
+
+  /** The token, 4 bits of each length */
+    // 15 means there is more of the length after it
+    unsigned char *token = out++;
+
+    *token = (literal_length < 15 ? literal_length : 15) << 4;
+
+  /** The literals */
+    if (literal_length >= 15)
+        out = pack_length (out, literal_length - 15);
+
+    memcpy (out, literals, literal_length);
+    out += literal_length;
+
+    if (match_length == 0)
+        return out;
+
+  /** The match, how far back it is and how long */
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+
+    //Lengths are stored as how much longer than the shortest match
+    match_length -= MIN_MATCH;
+
+    *token |= match_length < 15 ? match_length : 15;
+
+    if (match_length >= 15)
+        out = pack_length (out, match_length - 15);
+
+    return out;
+}
+
+/**
+ * Compress one block of at most PACK_BLOCK bytes into packed
+ *
+ * packed has to have room for PACK_BOUND bytes
+ *
+ * Returns the size of the compressed block
+ *
+ */
+size_t pack_block (const unsigned char *block, size_t length,
+                   unsigned char *packed)
+{
+    unsigned char *out = packed;
+
+    //Start of the literals that have not been written yet
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    //Misses in a row, for skipping
+    unsigned int misses = 0;
+
+  /** Look for matches */
+    // Tiny blocks are all literals
+    if (length > MATCH_LIMIT)
+    {
+        size_t last_start = length - MATCH_LIMIT;
+        size_t last_end = length - LAST_LITERALS;
+
+        while (pos < last_start)
+        {
+            unsigned int hash = PACK_HASH (block + pos);
+            size_t match = hash_table[hash];
+
+            hash_table[hash] = pos;
+
+        /** Same 4 bytes earlier on? */
+            if (match >= pos || memcmp (block + match, block + pos, MIN_MATCH) != 0)
+            {
+                pos += 1 + (misses++ >> SKIP_AFTER_MISSES);
+                continue;
+            }
+
+            misses = 0;
+
+        /** Make the match as long as it goes */
+            // Backwards, into the literals before it
+            while (pos > anchor && match > 0 && block[pos - 1] == block[match - 1])
+            {
+                pos--;
+                match--;
+            }
+
+            // And forwards
+            size_t end = pos + MIN_MATCH;
+
+            while (end < last_end && block[end] == block[match + end - pos])
+                end++;
+
+        /** Write it with the literals before it */
+            out = pack_sequence (out, block + anchor, pos - anchor,
+                                 pos - match, end - pos);
+
+            pos = anchor = end;
+
+            //Remember a position inside the match as well,
+            // the next match often starts there
+            if (pos < last_start)
+                hash_table[PACK_HASH (block + pos - 2)] = pos - 2;
+        }
+    }
+
+  /** The rest of the block is literals */
+    out = pack_sequence (out, block + anchor, length - anchor, 0, 0);
+
+    return out - packed;
+}
+
+/**
+ * Write a number as 4 bytes, lowest first
+ *
+ */
+void write_size (block_writer out, unsigned long size)
+{
+    char bytes[4];
+
+    for (int i = 0; i < 4; i++)
+        bytes[i] = (size >> (8 * i)) & 0xff;
+
+    block_writer_write (out, bytes, 4);
+}
+
+/**
+ * Pack everything read by reader into an LZ4 frame
+ *
+ */
+void pack (block_reader reader, block_writer out)
+{
+    unsigned char *packed;
+    char *data;
+    size_t size;
+
+    if ((packed = malloc (PACK_BOUND)) == NULL)
+        exit_with_error ("Could not allocate memory");
+
+    stats.allocations++;
+
+    block_writer_write (out, frame_header, sizeof (frame_header));
+
+  /** One block at a time */
+    // The reader hands out at most PACK_BLOCK bytes, unless the
+    // file is mapped into memory, then it is cut up here
+    while ((size = block_reader_next (reader, &data)) != 0)
+        for (size_t done = 0; done < size;)
+        {
+            size_t length = size - done;
+
+            if (length > (size_t) PACK_BLOCK)
+                length = PACK_BLOCK;
+
+            size_t packed_length =
+                pack_block ((unsigned char *) data + done, length, packed);
+
+        /** Store the block as it is if it didn't get smaller */
+            // The highest bit of the size says so
+            if (packed_length >= length)
+            {
+                write_size (out, length | 0x80000000UL);
+                block_writer_write (out, data + done, length);
+                blocks_stored++;
+            }
+            else
+            {
+                write_size (out, packed_length);
+                block_writer_write (out, (char *) packed, packed_length);
+                blocks_packed++;
+            }
+
+            done += length;
+        }
+
+  /** End of the frame */
+    write_size (out, 0);
+
+    free (packed);
+
+    stats_extra ("blocks packed", blocks_packed);
+    stats_extra ("blocks stored", blocks_stored);
+}
+
+/**
+ * Unpack everything read by reader
+ *
+ * The block reader does all the work, a file that is not
+ * compressed is copied as it is
+ *
+ */
+void unpack (block_reader reader, block_writer out)
+{
+    char *data;
+    size_t size;
+
+    while ((size = block_reader_next (reader, &data)) != 0)
+        block_writer_write (out, data, size);
+}
+
+/**
+ * Name of the file to write, when -o is not given
+ *
+ * filename.lz4 when packing, filename without .lz4 when unpacking
+ *
+ */
+char *output_name (char *filename, bool unpacking)
+{
+    size_t length = strlen (filename);
+    char *name;
+
+    if ((name = malloc (length + 5)) == NULL)
+        exit_with_error ("Could not allocate memory");
+
+    strcpy (name, filename);
+
+    if (!unpacking)
+    {
+        strcat (name, ".lz4");
+        return name;
+    }
+
+  /** Take off .lz4 */
+    // .LZ4 as well as .lz4
+    char *extension = name + length - 4;
+
+    if (length <= 4 || (extension[0] != '.'
+                        || (extension[1] | 0x20) != 'l'
+                        || (extension[2] | 0x20) != 'z'
+                        || extension[3] != '4'))
+        exit_with_error ("No .lz4 to take off the name, use -o");
+
+    *extension = '\0';
+
+    return name;
+}
+
+/**
+ * main() using arguments
+ * Extended argument processing (AgDev) is used
+ *
+ */
+int main (int argc, char *argv[])
+{
+    FILE *file = NULL;
+    FILE *output = NULL;
+    char *filename = NULL;
+    char *output_filename = NULL;
+
+    //Output name made from filename, to free at the end
+    char *made_name = NULL;
+    bool to_stdout = false;
+    bool unpacking = false;
+
+  /** Argument processing */
+    for (int i = 1; i != argc; i++)
+    {
+        if (strcmp (argv[i], "-h") == 0)
+        {
+            show_usage (argv[0]);
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp (argv[i], "-c") == 0)
+        {
+            to_stdout = true;
+        }
+        else if (strcmp (argv[i], "-d") == 0)
+        {
+            unpacking = true;
+        }
+        else if (strcmp (argv[i], "-o") == 0 && i + 1 != argc)
+        {
+            output_filename = argv[++i];
+        }
+        else if (strcmp (argv[i], "-S") == 0)
+        {
+            stats_start ();
+        }
+        else if (!filename)
+        {
+            filename = argv[i];
+        }
+        else
+        {
+            show_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+  /** Check that we have a filename */
+    if (filename == NULL)
+    {
+        show_usage (argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+  /** Open the files */
+    if (!(file = fopen (filename, "rb")))
+        exit_with_error ("Error opening file");
+
+    if (to_stdout)
+        output = stdout;
+    else
+    {
+        if (output_filename == NULL)
+            output_filename = made_name = output_name (filename, unpacking);
+
+        if (!(output = fopen (output_filename, "wb")))
+            exit_with_error ("Error creating output file");
+    }
+
+  /** Pack or unpack */
+    // The reader hands out blocks of exactly the size they are packed in
+    block_reader reader = block_reader_open (file, PACK_BLOCK);
+    block_writer out = block_writer_open (output, 0);
+
+    if (unpacking)
+        unpack (reader, out);
+    else
+        pack (reader, out);
+
+    //A compressed file that ended early, what was written is not all
+    const char *error = block_reader_error (reader);
+
+    block_writer_close (out);
+    block_reader_close (reader);
+
+  /** All done */
+    fclose (file);
+
+    if (output != stdout && fclose (output) != 0)
+        exit_with_error ("Error writing to output file");
+
+    if (error != NULL)
+    {
+        fprintf (stderr, "%s: %s\n", filename, error);
+        free (made_name);
+
+        return EXIT_FAILURE;
+    }
+
+    free (made_name);
+    stats_report ();
+    return EXIT_SUCCESS;
+}
@@ -1,46 +1,521 @@
+/**
+ * strings for Agon Light
+ *
+ * Prints runs of printable characters found in a (binary) file
+ *
+ * Original by Vasco Costa
+ * Modifications by E.M. From
+ *
+ * Runs are collected in a fixed size buffer. Once a run has reached
+ * the minimum length it is known to be printed, so whenever the buffer
+ * fills up it is simply flushed to stdout and collection starts over
+ * at the beginning of the buffer.
+ *
+ * This way runs of any length are printed, memory use stays constant
+ * and no run is ever copied around.
+ *
+ * Several encodings can be looked for at the same time. Every encoding
+ * gets its own run tracker (with its own buffer) and every byte read
+ * is handed to all of them, so the file is only read once no matter
+ * how many encodings are asked for.
+ *
+ * Several files can be scanned in one go, they all share the same trackers.
+ * LZ4 files are decompressed, an LZ4 file that can't be is reported and
+ * the next file scanned. With -R they are scanned as they are.
+ *
+ * With a filter pattern, every run is checked for the pattern as soon as it
+ * is complete and only the runs containing it are printed. A long run that
+ * has not matched yet when its buffer fills up gets a bigger buffer, since
+ * it cannot be printed before we know if it matches.
+ *
+ * Options recognized are:
+ * -h show help
+ * -n N minimum length of a run
+ * -t d|x prefix every run with its offset in the file (decimal or hex)
+ * -f prefix every run with the name of the file
+ * -e ENC encodings to look for, any combination of
+ *        s 7-bit ASCII (default)
+ *        S 8-bit, ASCII and Latin-1
+ *        l 16-bit little endian (UTF-16LE)
+ *        b 16-bit big endian (UTF-16BE)
+ * -m PATTERN only print strings containing PATTERN
+ * -R read LZ4 files as they are, don't decompress them
+ * -u print output at once, unbuffered
+ * -S show I/O statistics
+ *
+ */
+
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "blockio.h"
+#include "output.h"
+#include "stats.h"
+
+/**
+ * Size of the buffer runs are collected in
+ *
+ * If the minimum length asked for is larger, the buffer
+ * is made as large as the minimum length instead
+ */
+#ifndef STR_BUF_SIZE
+#define STR_BUF_SIZE 1024
+#endif
+
+/**
+ * Most trackers we can ever need
+ *
+ * One for 8-bit and two each for the 16-bit encodings,
+ * since a 16-bit string can start on an odd as well as an even offset
+ */
+#define MAX_TRACKERS 5
+
+/**
+ * Keeps track of a run in one encoding
+ *
+ */
+struct tracker_s
+{
+    //Encoding, one of s S l b
+    char encoding;
+
+    //16-bit only, pairs start on offsets where (offset & 1) == phase
+    int phase;
+
+    //First byte of a pair, and if we have one
+    int first_byte;
+    bool have_first;
+
+    //Where the run is collected
+    char *buf;
+    size_t buf_size;
+
+    //Characters waiting in buf
+    size_t cur_len;
+
+    //Length of the current run, including what has been flushed already
+    size_t run_len;
+
+    //Offset in the file of the first character in buf
+    long buf_offset;
+
+    //Is there an unfinished line of ours on stdout?
+    bool open;
+
+    //Filter only, has the run matched yet and how much of buf was searched
+    bool matched;
+    size_t searched;
+};
+
+typedef struct tracker_s *tracker;
+
+/**
+ * Settings and state shared by all trackers
+ *
+ */
+//Minimum length of a run
+size_t str_len = 4;
+
+//Size the buffers in the trackers start out with
+size_t buf_size;
+
+//Pattern runs must contain, or NULL to print all runs
+char *filter = NULL;
+size_t filter_len;
+
+//Filename to print, or NULL
+char *prefix_name = NULL;
+
+//Radix of the offsets printed, or 0 for no offsets
+int prefix_radix = 0;
+
+//Read LZ4 files as they are (-R)?
+bool read_raw = false;
+
+//Tracker that has an unfinished line on stdout, or NULL
+tracker owner = NULL;
+
+//Where runs are written to
+block_writer out;
+
+//Runs printed, for the statistics
+unsigned long runs_printed = 0;
+
+/**
+ * Helper function to print a help message
+ *
+ */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s [-hn min-len] filename\r\n", prog_name);
+    printf ("Usage: %s [-hf] [-n min-len] [-t d|x] [-e sSlb] [-m pattern]\r\n"
+            "       [-RuS] filename...\r\n",
+            prog_name);
     printf ("-h show this help message\r\n");
     printf ("-n strings at least min-len long (default: 4)\r\n");
+    printf ("-t print the offset of each string, d decimal, x hex\r\n");
+    printf ("-f print the filename before each string\r\n");
+    printf ("-e encodings, s 7-bit, S 8-bit, l UTF-16LE, b UTF-16BE\r\n");
+    printf ("-m only print strings containing pattern\r\n");
+    printf ("-R read LZ4 files as they are, don't decompress\r\n");
+    printf ("-u print output at once, unbuffered\r\n");
+    printf ("-S show I/O statistics\r\n");
 }
 
-void show_str (size_t str_len, FILE * file)
+/**
+ * Print what goes in front of a run
+ *
+ */
+void show_prefix (long offset)
 {
-    char ch;
-    char buf[1024];
-    size_t cur_len = 0;
+    if (prefix_name != NULL)
+    {
+        block_writer_puts (out, prefix_name);
+        block_writer_puts (out, ": ");
+    }
+
+    if (prefix_radix == 0)
+        return;
+
+    output_number (out, offset, prefix_radix, 7);
+    output_char (out, ' ');
+}
+
+/**
+ * Print what is in the buffer of a tracker
+ *
+ * If the run is complete the line is ended as well
+ *
+ */
+void tracker_flush (tracker t, bool complete)
+{
+
+  /** Someone else halfway through a line? */
+    // Can happen when two encodings find overlapping runs.
+    // End their line, they will continue on a line of their own
+    if (owner != NULL && owner != t)
+    {
+        block_writer_write (out, "\n", 1);
+        owner->open = false;
+    }
 
-    while (fread (&ch, 1, 1, file) > 0)
+  /** Start a new line? */
+    if (!t->open)
     {
-        if ((int) ch > 31 && (int) ch < 128)
+        show_prefix (t->buf_offset);
+        t->open = true;
+    }
+
+    block_writer_write (out, t->buf, t->cur_len);
+    t->cur_len = 0;
+    owner = t;
+
+  /** End the line */
+    if (complete)
+    {
+        runs_printed++;
+        block_writer_write (out, "\n", 1);
+        t->open = false;
+        owner = NULL;
+    }
+}
+
+/**
+ * Filter only, look for the pattern in the part of the buffer
+ * not searched yet
+ *
+ * Sets matched if the pattern is found
+ *
+ */
+void tracker_match (tracker t)
+{
+    //Pattern cannot fit?
+    if (t->cur_len < filter_len)
+        return;
+
+    //Last place the pattern can start
+    char *last = t->buf + t->cur_len - filter_len;
+
+    //Start positions before this have been tried already
+    char *here = t->buf + t->searched;
+
+  /** Look for the first character, then compare the rest */
+    while (here <= last
+           && (here = memchr (here, *filter, last - here + 1)) != NULL)
+    {
+        if (memcmp (here, filter, filter_len) == 0)
         {
-            buf[cur_len++] = ch;
+            t->matched = true;
+            return;
         }
-        else if (cur_len >= str_len)
+
+        here++;
+    }
+
+    t->searched = t->cur_len - filter_len + 1;
+}
+
+/**
+ * Add a printable character found at offset to the run
+ *
+ */
+void tracker_add (tracker t, char ch, long offset)
+{
+    //First character in the buffer?
+    if (t->cur_len == 0)
+        t->buf_offset = offset;
+
+    t->buf[t->cur_len++] = ch;
+    t->run_len++;
+
+  /** Buffer full? */
+    if (t->cur_len < t->buf_size)
+        return;
+
+    //Filtering and no match yet?
+    if (filter != NULL && !t->matched)
+        tracker_match (t);
+
+    //Since buf_size >= str_len the run is long enough to print,
+    // unless we have to wait for a match, flush what we have
+    // and keep on collecting
+    if (filter == NULL || t->matched)
+    {
+        tracker_flush (t, false);
+        return;
+    }
+
+    //No match yet, the whole run has to be kept
+    // Double the buffer to make room for more
+    char *bigger;
+
+    if ((bigger = realloc (t->buf, t->buf_size * 2)) == NULL)
+    {
+        fprintf (stderr, "Out of memory");
+        exit (EXIT_FAILURE);
+    }
+
+    t->buf = bigger;
+    t->buf_size *= 2;
+}
+
+/**
+ * A non printable character (or end of file) was found
+ *
+ */
+void tracker_end (tracker t)
+{
+    //Filtering and no match yet?
+    // Test the run now that it is complete
+    if (filter != NULL && !t->matched && t->run_len >= str_len)
+        tracker_match (t);
+
+    //Print the run if it is long enough (and matches)
+    // Not if all of it has been printed and another tracker has
+    // ended its line already, there is nothing left to put on it
+    if (t->run_len >= str_len && (filter == NULL || t->matched)
+        && (t->cur_len != 0 || t->open))
+        tracker_flush (t, true);
+
+    //Start over
+    t->cur_len = 0;
+    t->run_len = 0;
+    t->have_first = false;
+    t->matched = false;
+    t->searched = 0;
+}
+
+/**
+ * Is ch a printable character?
+ *
+ */
+bool is_printable (int ch, bool latin)
+{
+    //ASCII
+    if (ch > 31 && ch < 128)
+        return true;
+
+    //Latin-1 has printable characters from 160 and up
+    return latin && ch >= 160;
+}
+
+/**
+ * Hand the byte at offset to a tracker
+ *
+ */
+void tracker_feed (tracker t, int ch, long offset)
+{
+    switch (t->encoding)
+    {
+
+      /** 8-bit encodings, one byte is one character */
+    case 's':
+    case 'S':
+        if (is_printable (ch, t->encoding == 'S'))
+            tracker_add (t, ch, offset);
+        else
+            tracker_end (t);
+        break;
+
+      /** 16-bit encodings, two bytes are one character */
+    default:
+        //First byte of a pair?
+        if ((offset & 1) == t->phase)
         {
-            fwrite (buf, 1, cur_len, stdout);
-            printf ("\r\n");
-            cur_len = 0;
+            t->first_byte = ch;
+            t->have_first = true;
+            break;
         }
+
+        //A pair needs a first byte
+        if (!t->have_first)
+            break;
+
+        //Sort out high and low byte
+        int low = t->encoding == 'l' ? t->first_byte : ch;
+        int high = t->encoding == 'l' ? ch : t->first_byte;
+
+        //Only the ASCII part of the encoding is looked for
+        if (high == 0 && is_printable (low, false))
+            tracker_add (t, low, offset - 1);
         else
+            tracker_end (t);
+
+        t->have_first = false;
+        break;
+    }
+}
+
+/**
+ * Print all runs at least str_len long found by the trackers
+ *
+ * name is used for errors
+ *
+ * Returns false if the file could not all be read
+ *
+ */
+bool show_str (FILE * file, char *name, tracker trackers, int tracker_count)
+{
+    //The file is read in blocks by the block reader
+    block_reader reader = read_raw ? block_reader_open_raw (file, 0)
+        : block_reader_open (file, 0);
+    char *block;
+    size_t length;
+
+    //Offset in the file of the character we are looking at
+    // Counted as we go, so there is no need to ask the file for it
+    long offset = 0;
+
+  /** Hand every byte to every tracker */
+    while ((length = block_reader_next (reader, &block)) != 0)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            int ch = (unsigned char) block[i];
+
+            for (int j = 0; j < tracker_count; j++)
+                tracker_feed (&trackers[j], ch, offset);
+
+            offset++;
+        }
+    }
+
+  /** End of file ends all runs */
+    // Also when a compressed file ended early
+    for (int i = 0; i < tracker_count; i++)
+        tracker_end (&trackers[i]);
+
+    const char *error = block_reader_error (reader);
+
+    if (error != NULL)
+    {
+        block_writer_flush (out);
+        fprintf (stderr, "%s: %s\n", name, error);
+    }
+
+    block_reader_close (reader);
+
+    return error == NULL;
+}
+
+/**
+ * Set up the trackers for the encodings asked for
+ *
+ * Returns the number of trackers, or 0 on error
+ *
+ */
+int setup_trackers (char *encodings, tracker trackers)
+{
+    int count = 0;
+
+  /** 8-bit */
+    // S finds everything s finds, so there is no point in doing both
+    if (strchr (encodings, 'S'))
+        trackers[count++].encoding = 'S';
+    else if (strchr (encodings, 's'))
+        trackers[count++].encoding = 's';
+
+  /** 16-bit, both phases */
+    for (char *enc = "lb"; *enc; enc++)
+    {
+        if (!strchr (encodings, *enc))
+            continue;
+
+        for (int phase = 0; phase < 2; phase++)
         {
-            cur_len = 0;
+            trackers[count].encoding = *enc;
+            trackers[count++].phase = phase;
         }
     }
+
+  /** Nothing we know of? */
+    if (count == 0 || strspn (encodings, "sSlb") != strlen (encodings))
+        return 0;
+
+  /** Allocate the run buffers */
+    for (int i = 0; i < count; i++)
+    {
+        if ((trackers[i].buf = malloc (buf_size)) == NULL)
+            return 0;
+
+        trackers[i].buf_size = buf_size;
+        trackers[i].cur_len = 0;
+        trackers[i].run_len = 0;
+        trackers[i].have_first = false;
+        trackers[i].open = false;
+        trackers[i].matched = false;
+        trackers[i].searched = 0;
+    }
+
+    return count;
 }
 
+/**
+ * main() using arguments
+ * Extended argument processing (AgDev) is used
+ *
+ */
 int main (int argc, char *argv[])
 {
     FILE *file = NULL;
-    char *filename = NULL;
     int parsed_len = 0;
-    size_t str_len = 4;
+    bool show_names = false;
+    char *encodings = "s";
+    int status = 0;
+
+    //Filenames to scan, there can never be more of them than arguments
+    char **filenames;
+    int file_count = 0;
+
+    if ((filenames = malloc (argc * sizeof (char *))) == NULL)
+    {
+        fprintf (stderr, "Out of memory");
+
+        return 1;
+    }
 
+  /** Argument processing */
     for (int i = 1; i != argc; i++)
     {
         if (strcmp (argv[i], "-h") == 0)
@@ -51,9 +526,7 @@ int main (int argc, char *argv[])
         }
         else if (strncmp (argv[i], "-n", 2) == 0)
         {
-            parsed_len = atoi (argv[++i]);
-
-            if (parsed_len <= 0)
+            if (i + 1 == argc || (parsed_len = atoi (argv[++i])) <= 0)
             {
                 fprintf (stderr, "The min-len must be positive");
 
@@ -62,35 +535,139 @@ int main (int argc, char *argv[])
 
             str_len = parsed_len;
         }
-        else if (!filename)
+
+      /** Offset radix */
+        else if (strcmp (argv[i], "-t") == 0)
         {
-            filename = argv[i];
+            //Next argument is d or x
+            if (i + 1 != argc && strcmp (argv[i + 1], "d") == 0)
+                prefix_radix = 10;
+            else if (i + 1 != argc && strcmp (argv[i + 1], "x") == 0)
+                prefix_radix = 16;
+            else
+            {
+                fprintf (stderr, "The radix must be d or x");
+
+                return 1;
+            }
+
+            i++;
         }
-        else
+
+      /** Unbuffered output */
+        else if (strcmp (argv[i], "-u") == 0)
         {
-            show_usage (argv[0]);
+            output_unbuffered ();
+        }
 
-            return 0;
+      /** I/O statistics */
+        else if (strcmp (argv[i], "-S") == 0)
+        {
+            stats_start ();
+        }
+
+      /** LZ4 files as they are */
+        else if (strcmp (argv[i], "-R") == 0)
+        {
+            read_raw = true;
+        }
+
+      /** Print filenames */
+        else if (strcmp (argv[i], "-f") == 0)
+        {
+            show_names = true;
+        }
+
+      /** Encodings */
+        else if (strcmp (argv[i], "-e") == 0)
+        {
+            if (i + 1 == argc)
+            {
+                fprintf (stderr, "The encodings are missing");
+
+                return 1;
+            }
+
+            encodings = argv[++i];
+        }
+
+      /** Filter pattern */
+        else if (strcmp (argv[i], "-m") == 0)
+        {
+            if (i + 1 == argc || *argv[i + 1] == '\0')
+            {
+                fprintf (stderr, "The pattern is missing");
+
+                return 1;
+            }
+
+            filter = argv[++i];
+            filter_len = strlen (filter);
+        }
+
+      /** Anything else is a file to scan */
+        else
+        {
+            filenames[file_count++] = argv[i];
         }
     }
 
-    if (filename == NULL)
+    if (file_count == 0)
     {
         show_usage (argv[0]);
 
         return 0;
     }
 
-    if (!(file = fopen (filename, "r")))
+  /** Set up the trackers */
+    //Every buffer has to fit at least one run of the minimum length
+    // The same trackers are used for all files
+    buf_size = str_len > STR_BUF_SIZE ? str_len : STR_BUF_SIZE;
+
+    struct tracker_s trackers[MAX_TRACKERS];
+    int tracker_count;
+
+    if ((tracker_count = setup_trackers (encodings, trackers)) == 0)
     {
-        fprintf (stderr, "Error opening file");
+        fprintf (stderr, "Invalid encodings or out of memory");
 
         return 1;
     }
 
-    show_str (str_len, file);
-    printf ("\r\n");
-    fclose (file);
+  /** Scan the files one by one */
+    out = output_console ();
+
+    for (int i = 0; i < file_count; i++)
+    {
+        if (!(file = fopen (filenames[i], "r")))
+        {
+            //Go on with the other files, after what was found so far
+            block_writer_flush (out);
+            fprintf (stderr, "%s: can't open\n", filenames[i]);
+            status = 1;
+
+            continue;
+        }
+
+        prefix_name = show_names ? filenames[i] : NULL;
+
+        //Go on with the other files if this one can't all be read
+        if (!show_str (file, filenames[i], trackers, tracker_count))
+            status = 1;
+
+        fclose (file);
+    }
+
+    block_writer_write (out, "\n", 1);
+    block_writer_close (out);
+
+    for (int i = 0; i < tracker_count; i++)
+        free (trackers[i].buf);
+
+    free (filenames);
+
+    stats_extra ("runs printed", runs_printed);
+    stats_report ();
 
-    return 0;
+    return status;
 }
@@ -6,23 +6,41 @@
  * Original by Vasco Costa
  * Modifications by E.M. From
  *
- * This tail implementation uses fseek() to go to the end of the file
- * and from there read blocks backwards until it has found enough lines to print.
+ * This tail implementation uses the block reader to read blocks backwards,
+ * starting at the end of the file, until it has found enough lines to print.
  *
  * The size of the blocks are guestimated by assuming 20 characters per line,
- *  making each block 20 * the number of lines to print bytes long.
+ *  making each block 20 * the number of lines to print bytes long
+ *  (rounded up to whole sectors by the block reader).
  *
- * The blocks of text are stored on a stack and printed in reverse order.
+ * The block where the first line to print is found is printed straight
+ *  from the reader's buffer. Blocks after it are copied onto a stack
+ *  and printed in reverse order.
  *
  * This approach significantly increases the speed, particularily on large files,
  *  since as few lines as is reasonaby possible are read from the sdcard.
  *
+ * With -I the line index next to the file (see lineidx.h) tells how many
+ *  lines there are and where the first one to print is, close enough to
+ *  read forward from there.
+ *
+ * With -r the lines are printed last one first, as the file is read
+ *  backwards. A line is printed as soon as its start has been found, so
+ *  nothing has to be stacked. Only the end of a line that goes across
+ *  blocks is kept, until the block with its start is read.
+ *
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "blockio.h"
+#include "lineidx.h"
+#include "output.h"
+#include "stats.h"
+
 /**
  * An (un)educated guess of how long an average text line is
  *
@@ -40,9 +58,13 @@
  */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s [-hn] filename\r\n", prog_name);
+    printf ("Usage: %s [-hnrIuS] filename\r\n", prog_name);
     printf ("-h show this help message\r\n");
     printf ("-n print the last n lines (default: 10)\r\n");
+    printf ("-r print them last line first (default: all lines)\r\n");
+    printf ("-I use a line index, made if needed\r\n");
+    printf ("-u print output at once, unbuffered\r\n");
+    printf ("-S show I/O statistics\r\n");
 }
 
 /**
@@ -100,6 +122,8 @@ text_stack text_stack_push (text_stack stack, char *text, size_t size)
     if (new_entry == NULL)
         exit_with_error ("Could not allocate memory");
 
+    stats.allocations++;
+
   /** Assign variables */
     //The old top of the stack is now below what we just added
     new_entry->below_this = stack;
@@ -151,111 +175,113 @@ text_stack text_stack_pop (text_stack stack, char **text, size_t *size)
 void show_lines (FILE * file, int lines)
 {
 
-  /** Determine file size */
-    long filesize;
+  /** Variables needed */
+    //Blocks are read backwards by the block reader
+    block_reader reader =
+        block_reader_open (file, lines * LINE_LENGTH_GUESSTIMATE);
+    char *block;
+    size_t size;
 
-    //Move read pointer to end of file
-    if (0 != fseek (file, 0L, SEEK_END))
-        exit_with_error ("Filesystem error");
+    //Output goes through the block writer
+    block_writer out = output_console ();
 
-    //Get the file position we are at
-    // since we are at the end of the fils,
-    // position is equal to the size of the file
-    filesize = ftell (file);
-    if (filesize == -1)
-        exit_with_error ("Filesystem error");
+    //Amount of line endings found, aka'\n'
+    // Since we are reading backwards this means
+    // lines we have found - 1
+    int line_endings_found = 0;
+
+    //The line ending before the first line to print
+    int line_endings_wanted = lines;
+
+    //Stack for the blocks after the one with the first line to print
+    // NULL in this case means we start with an empty stack
+    text_stack stack = NULL;
+
+    //Offset of the first line to print in the block
+    // -1 until it has been found
+    long offset = -1;
+
+    //Blocks pushed onto the stack, for the statistics
+    unsigned long blocks_stacked = 0;
 
   /** Implicit newline at end of file? */
     // If last char is not a newline, we add one so that
     //  lines will print properly
     int implicit_newline = 0;
 
-    //Move read pointer to last character in file
-    if (0 != fseek (file, -1L, SEEK_END))
-        exit_with_error ("Filesystem error");
+    //First block is the end of the file
+    if ((size = block_reader_prev (reader, &block)) == 0)
+    {
+        //Empty file, nothing to print
+        block_writer_close (out);
+        block_reader_close (reader);
+        return;
+    }
 
     //Check last character
-    if (fgetc (file) != '\n')
+    if (block[size - 1] == '\n')
     {
-        // As the last line will not count as a line in the code
-        //  below, remove one line to look for
-        lines--;
-        implicit_newline = 1;
+        // The newline ending the last line is not the start
+        //  of a line, so look for one more
+        line_endings_wanted++;
     }
+    else
+        implicit_newline = 1;
 
-  /** Guesstimate how much to load */
-    size_t loadsize = lines * LINE_LENGTH_GUESSTIMATE;
-
-  /** Variables needed */
-    //Keep track of how much text has been loaded
-    size_t size_loaded = 0;
-
-    //Amount of line endings found, aka'\n' 
-    // Since we are reading backwards this means
-    // lines we have found - 1
-    int line_endings_found = 0;
-
-    //Stack for the loaded text
-    // NULL in this case means we start with an empty stack
-    text_stack stack = NULL;
-
-    //Offset of the first line to print in the
-    // first block to print
-    int offset;
-
-  /** Loop until we have as many lines as we want 
+  /** Loop until we have as many lines as we want
       OR we run out of file to load */
-    while (line_endings_found <= lines && size_loaded < filesize)
+    for (;;)
     {
 
-        //Check that there is enough text left in the file
-        // for us to load an entire block
-        if (size_loaded + loadsize > filesize)
-            // If not, read the rest of the file
-            loadsize = filesize - size_loaded;
+    /** Count lines in the block */
+        // Going backwards from the end of the block
+        for (long i = size - 1; i >= 0; i--)
+            if (block[i] == '\n' && ++line_endings_found == line_endings_wanted)
+            {
+                //First line to print starts after this newline
+                offset = i + 1;
+                break;
+            }
+
+        //Found the first line to print?
+        if (offset != -1)
+            break;
+
+        //Start of the file? Then all of this block is printed, from
+        // where it is, the reader has no more blocks to put in its place
+        if (block_reader_at_start (reader))
+        {
+            offset = 0;
+            break;
+        }
 
-    /** Allocate a buffer */
+    /** Push a copy onto the stack */
+        // i.e. put this block on the top
+        // A copy is needed, the reader reuses its buffer
         char *text_buffer;
 
-        text_buffer = malloc (loadsize);
+        text_buffer = malloc (size);
         if (text_buffer == NULL)
             exit_with_error ("Could not allocate memory");
 
-    /** Reposition the read point in the file */
-        if (0 != fseek (file, 0L - (size_loaded + loadsize), SEEK_END))
-            exit_with_error ("Filesystem error");
-
-    /** Fill the buffer from file */
-        if (1 != fread (text_buffer, loadsize, 1, file))
-            exit_with_error ("Filesystem error");
-
-        //Update how much we have loaded
-        size_loaded += loadsize;
-
-    /** Count lines in the text_buffer */
-        // On exit, offset will point to the last newline before the first line to print
-        // Which is used as is (I.e. print a newline before the lines)
-        // This is to avoid odd cases where the only char that's in a block is a
-        // newline that will not be printed
-        //
-        // Note: There are two conditions in the for:loop
-        for (offset = loadsize;
-             offset >= 0 && line_endings_found <= lines; offset--)
-            if (text_buffer[offset] == '\n')
-                line_endings_found++;
-
-    /** Push onto the stack */
-        // i.e. put this block on the top
-        stack = text_stack_push (stack, text_buffer, loadsize);
+        stats.allocations++;
+
+        memcpy (text_buffer, block, size);
+        stack = text_stack_push (stack, text_buffer, size);
+        blocks_stacked++;
 
+    /** Get the block before this one */
+        if ((size = block_reader_prev (reader, &block)) == 0)
+        {
+            //Start of file, everything is printed
+            break;
+        }
     }
 
-  /** Make sure offset is valid */
-    //If all data loaded will be printed
-    //(or by happenstance exactly at the start of a buffer)
-    // we set offset to 0
-    if (offset == -1)
-        offset = 0;
+  /** Print the block with the first line to print */
+    // If we ran out of file there is no such block
+    if (offset != -1)
+        block_writer_write (out, block + offset, size - offset);
 
   /** Print the lines found */
     // NULL mean the stack is empty
@@ -264,28 +290,10 @@ void show_lines (FILE * file, int lines)
 
     /** Get the text block to print from the stack */
         char *text;
-        size_t size;
 
         stack = text_stack_pop (stack, &text, &size);
 
-    /** Check if we are printing the first block */
-        // If offset is non-zero, this is the first block
-        // and we offset printing so that only the lines
-        // that we want are printed
-        if (offset)
-        {
-            //Print with fwrite because it's (probably) faster
-            if (1 != fwrite (text + offset, size - offset, 1, stdout))
-                exit_with_error ("Standard output error");
-
-            //offset = 0 means the rest of the blocks will be printed
-            // as is
-            offset = 0;
-        }
-        else
-            //For blocks other than the first block, print everything
-        if (1 != fwrite (text, size, 1, stdout))
-            exit_with_error ("Standard output error");
+        block_writer_write (out, text, size);
 
     /** Free up the text buffer */
         free (text);
@@ -293,7 +301,194 @@ void show_lines (FILE * file, int lines)
 
   /** Write implicit newline, if needed */
     if (implicit_newline)
-        printf ("\n");
+        block_writer_write (out, "\n", 1);
+
+    block_writer_close (out);
+    block_reader_close (reader);
+
+    stats_extra ("blocks stacked", blocks_stacked);
+}
+
+/**
+ * The end of a line whose start has not been read yet, for -r
+ *
+ * Text is added in front of what is there already, so it is kept at
+ * the end of the buffer and grows towards the start of it
+ *
+ */
+struct carry
+{
+    char *buf;
+    size_t size;
+    size_t length;
+};
+
+/**
+ * Add text in front of what is carried
+ *
+ */
+void carry_add (struct carry *carry, const char *text, size_t length)
+{
+
+  /** Make room, moving what is there to the end of a larger buffer */
+    if (carry->length + length > carry->size)
+    {
+        size_t size = (carry->length + length) * 2;
+        char *buf;
+
+        if ((buf = malloc (size)) == NULL)
+            exit_with_error ("Could not allocate memory");
+
+        stats.allocations++;
+
+        if (carry->length != 0)
+            memcpy (buf + size - carry->length,
+                    carry->buf + carry->size - carry->length, carry->length);
+
+        free (carry->buf);
+        carry->buf = buf;
+        carry->size = size;
+    }
+
+  /** Put the text in front */
+    carry->length += length;
+    memcpy (carry->buf + carry->size - carry->length, text, length);
+}
+
+/**
+ * Print a line, length characters of text and what is carried after it
+ *
+ * Adds a newline if it doesn't have one, only the last line of a file
+ * can be without one
+ *
+ */
+void print_reversed_line (block_writer out, const char *text, size_t length,
+                          struct carry *carry)
+{
+    char last;
+
+    block_writer_write (out, text, length);
+
+    if (carry->length != 0)
+    {
+        block_writer_write (out, carry->buf + carry->size - carry->length,
+                            carry->length);
+        last = carry->buf[carry->size - 1];
+        carry->length = 0;
+    }
+    else
+        last = text[length - 1];
+
+    if (last != '\n')
+        block_writer_write (out, "\n", 1);
+}
+
+/**
+ * Display the last N lines from file, last line first
+ *
+ * lines is 0 for all lines
+ *
+ */
+void show_lines_reversed (FILE * file, size_t lines)
+{
+    block_reader reader =
+        block_reader_open (file, lines * LINE_LENGTH_GUESSTIMATE);
+    block_writer out = output_console ();
+    char *block;
+    size_t size;
+
+    struct carry carry = { NULL, 0, 0 };
+    size_t printed = 0;
+
+    //All lines is as many as there can be
+    if (lines == 0)
+        lines = (size_t) -1;
+
+  /** Go backwards through the file */
+    while ((size = block_reader_prev (reader, &block)) != 0)
+    {
+        //End of the line being looked for in this block, after its newline
+        size_t end = size;
+
+    /** A newline means the line after it is complete */
+        // i goes from size - 1 down to 0
+        for (size_t i = size; i-- > 0 && printed != lines;)
+            if (block[i] == '\n')
+            {
+                //Empty only after the newline at the end of the file,
+                // there is no line there
+                if (end != i + 1 || carry.length != 0)
+                {
+                    print_reversed_line (out, block + i + 1, end - i - 1,
+                                         &carry);
+                    printed++;
+                }
+
+                end = i + 1;
+            }
+
+        if (printed == lines)
+            break;
+
+    /** The start of the file is the start of the first line */
+        // Printed from where it is, there is no earlier block to carry
+        // it over to
+        if (block_reader_at_start (reader))
+        {
+            print_reversed_line (out, block, end, &carry);
+            break;
+        }
+
+    /** The rest is the end of a line that starts in an earlier block */
+        carry_add (&carry, block, end);
+    }
+
+  /** The start of the file is the start of the first line */
+    if (carry.length != 0)
+        print_reversed_line (out, "", 0, &carry);
+
+    block_writer_close (out);
+    block_reader_close (reader);
+
+    stats_extra ("carry buffer", carry.size);
+    free (carry.buf);
+}
+
+/**
+ * Display everything from a line on, with the file at a line before it
+ *
+ * Used with the line index, which has put the file skip lines before
+ * the first line to print
+ *
+ */
+void show_lines_from (FILE * file, unsigned long skip)
+{
+    block_reader reader = block_reader_open (file, 0);
+    block_writer out = output_console ();
+    char *text;
+    size_t size;
+    bool complete;
+
+    //Last character printed, to add a newline if the file has none
+    char last = '\n';
+
+  /** Skip the lines before the first one to print */
+    while (skip > 0 && (size = block_reader_line (reader, &text, &complete)) != 0)
+        if (complete)
+            skip--;
+
+  /** Print the rest */
+    while ((size = block_reader_next (reader, &text)) != 0)
+    {
+        block_writer_write (out, text, size);
+        last = text[size - 1];
+    }
+
+    if (last != '\n')
+        block_writer_write (out, "\n", 1);
+
+    block_writer_close (out);
+    block_reader_close (reader);
 }
 
 /**
@@ -308,6 +503,14 @@ int main (int argc, char *argv[])
     int parsed_lines = 0;
     size_t lines = 10;
 
+    //Was a number of lines given, last line first?
+    bool lines_given = false;
+    bool reverse = false;
+
+    //Use the line index?
+    bool use_index = false;
+    line_index index;
+
   /** Argument processing */
     for (int i = 1; i != argc; i++)
     {
@@ -330,6 +533,7 @@ int main (int argc, char *argv[])
                 exit_with_error ("The number of lines must be positive");
 
             lines = parsed_lines;
+            lines_given = true;
         }
 
     /** User specified number of lines as -N*/
@@ -339,6 +543,31 @@ int main (int argc, char *argv[])
                 exit_with_error ("The number of lines must be positive");
 
             lines = parsed_lines;
+            lines_given = true;
+        }
+
+    /** User wants the last line first */
+        else if (strcmp (argv[i], "-r") == 0)
+        {
+            reverse = true;
+        }
+
+    /** User wants the line index */
+        else if (strcmp (argv[i], "-I") == 0)
+        {
+            use_index = true;
+        }
+
+    /** User wants output unbuffered */
+        else if (strcmp (argv[i], "-u") == 0)
+        {
+            output_unbuffered ();
+        }
+
+    /** User wants I/O statistics */
+        else if (strcmp (argv[i], "-S") == 0)
+        {
+            stats_start ();
         }
 
     /** First non option argument is (probably) filename */
@@ -368,9 +597,23 @@ int main (int argc, char *argv[])
         exit_with_error ("Error opening file");
 
   /** Show last N lines in file */
-    show_lines (file, lines);
+    // Backwards, all of them unless told otherwise
+    if (reverse)
+        show_lines_reversed (file, lines_given ? lines : 0);
+    else if (use_index && (index = line_index_open (file, filename)) != NULL)
+    {
+        //With the index, go forward from the closest indexed line
+        unsigned long total = line_index_lines (index);
+        unsigned long first = total > lines ? total - lines : 0;
+
+        show_lines_from (file, first - line_index_seek (index, file, first));
+        line_index_close (index);
+    }
+    else
+        show_lines (file, lines);
 
   /** All done, exiting */
     fclose (file);
+    stats_report ();
     return EXIT_SUCCESS;;
 }
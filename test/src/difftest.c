@@ -0,0 +1,2159 @@
+/**
+ * Differential tests for the utilities
+ *
+ * By E.M. From
+ *
+ * Runs the host builds of the utilities on random input and compares
+ * what they print with a reference model, a deliberately simple (and
+ * slow) version of the same utility that reads everything into memory
+ * and goes through it one byte at a time.
+ *
+ * The input is random the way a fuzzer makes it, but with a structure
+ * that finds the hard cases quickly: \n and \r\n line endings, files
+ * without a final newline, empty lines, control characters, NUL and
+ * high bytes, and lines longer than the buffers of the utilities.
+ *
+ * Every iteration uses its own seed, so a failure can be repeated with
+ * -s seed -n 1. The input of a failure is saved in the test folder,
+ * together with the expected output and what the utility printed.
+ *
+ * With -u head and grep are also compared with the coreutils versions,
+ * where the two behave the same.
+ *
+ * Host build only.
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Most arguments a test can pass
+ *
+ */
+#define MAX_ARGS 12
+
+/**
+ * How much of a file grep looks at to tell if it is binary
+ *
+ * grep's LINEMAX, the size of its reader's buffer
+ */
+#define GREP_BINARY_CHECK 16384
+
+/**
+ * Line length grep is guaranteed to see whole lines up to
+ *
+ * grep's LINEMAX less one sector, longer lines are searched in pieces
+ */
+#define GREP_LINE_MAX (16384 - 512)
+
+/**
+ * Size of the buffers strings collects runs in, its STR_BUF_SIZE
+ *
+ * A run that fills one is printed in pieces, and a piece of a run
+ * in another encoding printed in between breaks up its line
+ */
+#define STRINGS_BUF_SIZE 1024
+
+/**
+ * A growing buffer
+ *
+ */
+struct buffer
+{
+    char *data;
+    size_t length;
+    size_t size;
+};
+
+/**
+ * How a test hands the input to the utility
+ *
+ */
+enum input_kind
+{
+    //Not at all, everything is in the arguments
+    NO_INPUT,
+
+    //As a file, the last argument
+    INPUT_FILE,
+
+    //As a file, and what the utility prints is unpacked with
+    // pack -d before it is compared
+    INPUT_FILE_UNPACK,
+
+    //As a file, twice: first_input, then input (see make_growing_log),
+    // what is printed both times is compared
+    INPUT_FILE_TWICE,
+
+    //As a file packed with pack, the reference sees the input as it
+    // was, or (raw) the packed bytes
+    INPUT_FILE_PACKED,
+    INPUT_FILE_PACKED_RAW,
+
+    //As a file packed with pack and cut short, anywhere after the
+    // LZ4 magic number
+    INPUT_FILE_PACKED_CUT,
+};
+
+/**
+ * One test case
+ *
+ * setup makes the input and the arguments, reference works out
+ * what the utility should print
+ *
+ */
+struct test_case
+{
+    char *name;
+    char *tool;
+    enum input_kind input;
+
+    void (*setup) (struct buffer * input, char **args);
+    int (*reference) (struct buffer * input, char **args,
+                      struct buffer * expected);
+
+    //Name of the coreutils version, if it behaves the same
+    char *coreutils;
+};
+
+/**
+ * Settings
+ *
+ */
+char *build = "build";
+char *folder = "build/test";
+bool use_coreutils = false;
+
+/**
+ * Random numbers, xorshift like in gencorpus
+ *
+ */
+unsigned long long random_state;
+
+unsigned long next_random (void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+
+    return (unsigned long) (random_state >> 16);
+}
+
+void seed_random (unsigned long long seed)
+{
+    random_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+/**
+ * Random number from 0 to limit - 1
+ *
+ */
+unsigned long random_below (unsigned long limit)
+{
+    return next_random () % limit;
+}
+
+/**
+ * Helper function to exit with an error message
+ *
+ */
+void exit_with_error (char *message)
+{
+    fprintf (stderr, "%s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+/**
+ * Buffer functions
+ *
+ */
+void buffer_add (struct buffer *buffer, const void *data, size_t length)
+{
+    if (length == 0)
+        return;
+
+    if (buffer->length + length > buffer->size)
+    {
+        buffer->size = (buffer->length + length) * 2 + 64;
+
+        if ((buffer->data = realloc (buffer->data, buffer->size)) == NULL)
+            exit_with_error ("Out of memory");
+    }
+
+    memcpy (buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+void buffer_addc (struct buffer *buffer, char ch)
+{
+    buffer_add (buffer, &ch, 1);
+}
+
+void buffer_printf (struct buffer *buffer, const char *format, ...)
+{
+    char text[256];
+    va_list list;
+    int length;
+
+    va_start (list, format);
+    length = vsnprintf (text, sizeof (text), format, list);
+    va_end (list);
+
+    buffer_add (buffer, text, length);
+}
+
+/**
+ * Write a buffer to a file
+ *
+ */
+void write_file (char *filename, struct buffer *buffer)
+{
+    FILE *file;
+
+    if ((file = fopen (filename, "wb")) == NULL)
+        exit_with_error ("Could not write the input file");
+
+    if (buffer->length != 0)
+        fwrite (buffer->data, 1, buffer->length, file);
+
+    fclose (file);
+}
+
+/**
+ * Arguments that are made up are kept in a pool of strings
+ *
+ */
+char arg_pool[MAX_ARGS][64];
+
+char *make_arg (int i, const char *format, ...)
+{
+    va_list list;
+
+    va_start (list, format);
+    vsnprintf (arg_pool[i], sizeof (arg_pool[i]), format, list);
+    va_end (list);
+
+    return arg_pool[i];
+}
+
+/**
+ * Count the arguments
+ *
+ */
+int arg_count (char **args)
+{
+    int count = 0;
+
+    while (args[count] != NULL)
+        count++;
+
+    return count;
+}
+
+/**
+ * Find an option in the arguments, returns the one after it or NULL
+ *
+ * For options without a value, returns the option itself
+ */
+char *find_arg (char **args, const char *option, bool has_value)
+{
+    for (int i = 0; args[i] != NULL; i++)
+        if (strcmp (args[i], option) == 0)
+            return has_value ? args[i + 1] : args[i];
+
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Input generators                                                    */
+/* ------------------------------------------------------------------ */
+
+/**
+ * Words text lines are made from, with the grep patterns among them
+ *
+ */
+const char *words[] = {
+    "sector", "buffer", "Agon", "error", "ERROR", "Error", "line", "mos",
+    "vdp", "needle", "NeEdLe", "a", "to", "of", "x", "ok"
+};
+
+/**
+ * Random text
+ *
+ * Lines are mostly words, with some control characters, high bytes
+ * and NULs thrown in. Some lines are very long. max_line limits how
+ * long a line can be, 0 means no limit.
+ *
+ */
+void make_text (struct buffer *input, size_t max_line)
+{
+    int lines = random_below (40);
+
+    for (int i = 0; i < lines; i++)
+    {
+        size_t wanted;
+        size_t start = input->length;
+
+      /** How long? */
+        switch (random_below (10))
+        {
+        case 0:
+            wanted = 0;
+            break;
+
+        case 1:
+            //Longer than the buffers
+            wanted = 3000 + random_below (30000);
+            break;
+
+        default:
+            wanted = random_below (100);
+            break;
+        }
+
+        if (max_line != 0 && wanted > max_line - 2)
+            wanted = max_line - 2;
+
+      /** Fill it */
+        while (input->length - start < wanted)
+        {
+            switch (random_below (20))
+            {
+            case 0:
+                //Control character, but not a line ending
+                buffer_addc (input, "\t\v\f\001\033\177"[random_below (6)]);
+                break;
+
+            case 1:
+                //High byte or NUL
+                buffer_addc (input, random_below (2) ? 0 : 128 +
+                             random_below (128));
+                break;
+
+            case 2:
+                //Lone \r
+                buffer_addc (input, '\r');
+                break;
+
+            default:
+                {
+                    const char *word = words[random_below (16)];
+
+                    buffer_add (input, word, strlen (word));
+                    buffer_addc (input, ' ');
+                }
+                break;
+            }
+        }
+
+        //Don't go over the limit with the last word
+        if (max_line != 0 && input->length - start > max_line - 2)
+            input->length = start + max_line - 2;
+
+      /** Line ending */
+        // The last line may not have one
+        if (i == lines - 1 && random_below (3) == 0)
+            break;
+
+        if (random_below (4) == 0)
+            buffer_add (input, "\r\n", 2);
+        else
+            buffer_addc (input, '\n');
+    }
+}
+
+/**
+ * Random binary data with strings in it
+ *
+ */
+void make_binary (struct buffer *input)
+{
+    int parts = random_below (60);
+    bool exact;
+
+    for (int i = 0; i < parts; i++)
+    {
+        switch (random_below (5))
+        {
+        case 0:
+        case 1:
+            //Random bytes
+            for (int j = random_below (64); j > 0; j--)
+                buffer_addc (input, random_below (256));
+            break;
+
+        case 2:
+            //ASCII, sometimes very long
+            for (int j = random_below (10) == 0 ?
+                 1000 + random_below (5000) : random_below (20); j > 0; j--)
+                buffer_addc (input, 32 + random_below (95));
+            break;
+
+        case 3:
+            //UTF-16LE, sometimes very long. Or between control
+            // characters and after a NUL, so it is as long in UTF-16BE,
+            // just filling strings' buffers in both
+            exact = random_below (10) == 0;
+
+            if (exact)
+                buffer_add (input, "\1\1\0", 3);
+
+            for (int j = exact ? STRINGS_BUF_SIZE * (1 + random_below (2))
+                 : random_below (10) == 0 ? 1000 + random_below (2000)
+                 : random_below (20); j > 0; j--)
+            {
+                buffer_addc (input, 32 + random_below (95));
+                buffer_addc (input, 0);
+            }
+
+            if (exact)
+                buffer_add (input, "\1\1", 2);
+            break;
+
+        default:
+            //Latin-1
+            for (int j = random_below (20); j > 0; j--)
+                buffer_addc (input, random_below (2) ?
+                             32 + random_below (95) : 160 + random_below (96));
+            break;
+        }
+    }
+}
+
+/**
+ * Put -j N in front of the arguments
+ *
+ * The output has to be the same for every N, so the reference of
+ * the test without -j is used. Lines and words then cross the edges
+ * of the chunks the threads scan, more of them with a small
+ * PARALLEL_CHUNK (make check builds one, see the makefile).
+ *
+ */
+void add_jobs (char **args)
+{
+    memmove (args + 2, args, (MAX_ARGS - 2) * sizeof (char *));
+
+    args[0] = "-j";
+    args[1] = make_arg (MAX_ARGS - 1, "%lu", 1 + random_below (8));
+}
+
+/**
+ * A log, for the line index
+ *
+ * Many more lines than make_text makes, so the index has more than
+ * one entry (one every LINEIDX_STRIDE, 256 lines), mostly short but
+ * with a few long lines too. The last line may have no newline.
+ *
+ */
+void make_log (struct buffer *input)
+{
+    for (int i = random_below (60); i > 0; i--)
+        make_text (input, 200);
+
+    make_text (input, 0);
+}
+
+/**
+ * What the log was the first time the utility ran
+ *
+ */
+struct buffer first_input;
+
+/**
+ * A log that changes between two runs
+ *
+ * first_input is the log the first time, input the second time:
+ * - first_input with more lines added, the usual case
+ * - another log, it was replaced (rotated)
+ * - first_input with lines put in the middle, it was replaced
+ *   by one that starts the same and is longer
+ * - first_input again, nothing changed
+ *
+ */
+void make_growing_log (struct buffer *input)
+{
+    size_t half;
+
+    first_input.length = 0;
+    make_log (&first_input);
+
+    switch (random_below (4))
+    {
+    case 0:
+        buffer_add (input, first_input.data, first_input.length);
+        make_log (input);
+        break;
+
+    case 1:
+        make_log (input);
+        break;
+
+    case 2:
+        half = first_input.length / 2;
+
+        buffer_add (input, first_input.data, half);
+        make_log (input);
+        buffer_addc (input, '\n');
+        buffer_add (input, first_input.data + half,
+                    first_input.length - half);
+        break;
+
+    default:
+        buffer_add (input, first_input.data, first_input.length);
+        break;
+    }
+}
+
+/**
+ * Put option in front of the arguments
+ *
+ * In front, as tail's -N and grep's pattern have to be the last one
+ *
+ */
+void add_first (char **args, char *option)
+{
+    memmove (args + 1, args, (MAX_ARGS - 1) * sizeof (char *));
+
+    args[0] = option;
+}
+
+/* ------------------------------------------------------------------ */
+/* head                                                                */
+/* ------------------------------------------------------------------ */
+
+/**
+ * -n N, or -r A,B for lines A to B, with lines up to about max
+ *
+ */
+void head_options (char **args, unsigned long max)
+{
+    unsigned long from = 1 + random_below (max);
+
+    if (random_below (2))
+    {
+        args[0] = "-n";
+        args[1] = make_arg (1, "%lu", from);
+    }
+    else
+    {
+        args[0] = "-r";
+        args[1] = make_arg (1, "%lu,%lu", from, from + random_below (50));
+    }
+}
+
+void setup_head (struct buffer *input, char **args)
+{
+    make_text (input, 0);
+    head_options (args, 50);
+}
+
+/**
+ * head -I, on a log that changes between two runs
+ *
+ */
+void setup_head_index (struct buffer *input, char **args)
+{
+    make_growing_log (input);
+    head_options (args, 3000);
+    add_first (args, "-I");
+}
+
+int reference_head (struct buffer *input, char **args,
+                    struct buffer *expected)
+{
+    char *count = find_arg (args, "-n", true);
+    char *range = find_arg (args, "-r", true);
+    long skip = 0;
+    long lines = count != NULL ? atol (count) : 10;
+    size_t start;
+    size_t i;
+
+    //-r A,B skips A - 1 lines and shows B - A + 1
+    if (range != NULL)
+    {
+        skip = atol (range) - 1;
+        lines = atol (strchr (range, ',') + 1) - skip;
+    }
+
+    //After the newline ending the last line skipped
+    for (i = 0; i < input->length && skip > 0; i++)
+        if (input->data[i] == '\n')
+            skip--;
+
+    //Up to and including the newline ending the last line shown
+    for (start = i; i < input->length && lines > 0; i++)
+        if (input->data[i] == '\n')
+            lines--;
+
+    buffer_add (expected, input->data + start, i - start);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* tail                                                                */
+/* ------------------------------------------------------------------ */
+
+/**
+ * -n N or -N, maybe -r, with N up to max
+ *
+ */
+void tail_options (char **args, unsigned long max)
+{
+    int argc = 0;
+
+    //Last line first, and then maybe all lines
+    bool reverse = random_below (3) == 0;
+
+    if (reverse)
+        args[argc++] = "-r";
+
+    switch (random_below (reverse ? 3 : 2))
+    {
+    case 0:
+        args[argc++] = "-n";
+        args[argc] = make_arg (argc, "%lu", 1 + random_below (max));
+        break;
+
+    case 1:
+        args[argc] = make_arg (argc, "-%lu", 1 + random_below (max));
+        break;
+    }
+}
+
+void setup_tail (struct buffer *input, char **args)
+{
+    make_text (input, 0);
+    tail_options (args, 50);
+}
+
+/**
+ * tail -I, on a log that changes between two runs
+ *
+ * With -r the index is not used, it still has to work
+ *
+ */
+void setup_tail_index (struct buffer *input, char **args)
+{
+    make_growing_log (input);
+    tail_options (args, 3000);
+    add_first (args, "-I");
+}
+
+/**
+ * tail -r on a log, read backwards over many blocks
+ *
+ * Lines go across the blocks, some are longer than a block, and the
+ * last one may have no newline. Mostly all lines, or -n N.
+ *
+ */
+void setup_tail_reversed (struct buffer *input, char **args)
+{
+    make_log (input);
+
+    args[0] = "-r";
+
+    if (random_below (3) == 0)
+    {
+        args[1] = "-n";
+        args[2] = make_arg (2, "%lu", 1 + random_below (3000));
+    }
+}
+
+/**
+ * tail -r, the lines before end from last to first
+ *
+ * lines is -1 for all of them
+ *
+ */
+void reference_tail_reversed (struct buffer *input, long lines,
+                              struct buffer *expected)
+{
+    size_t end = input->length;
+
+    while (end > 0 && lines-- != 0)
+    {
+        //The line starts after the newline before its end
+        size_t start = end - 1;
+
+        while (start > 0 && input->data[start - 1] != '\n')
+            start--;
+
+        buffer_add (expected, input->data + start, end - start);
+
+        //Only the last line can be without a newline
+        if (input->data[end - 1] != '\n')
+            buffer_addc (expected, '\n');
+
+        end = start;
+    }
+}
+
+int reference_tail (struct buffer *input, char **args,
+                    struct buffer *expected)
+{
+    char *count = find_arg (args, "-n", true);
+    long lines = -1;
+    size_t length = input->length;
+    size_t start;
+
+    //-n N, or -N after the other options
+    if (count != NULL)
+        lines = atol (count);
+    else if (arg_count (args) != 0 && args[arg_count (args) - 1][1] != 'r')
+        lines = atol (args[arg_count (args) - 1] + 1);
+
+    if (find_arg (args, "-r", false) != NULL)
+    {
+        reference_tail_reversed (input, lines, expected);
+        return 0;
+    }
+
+    if (length == 0)
+        return 0;
+
+    //The newline ending the last line doesn't start a line
+    size_t end = input->data[length - 1] == '\n' ? length - 1 : length;
+
+    //Go back until N newlines have been passed
+    for (start = end; start > 0; start--)
+        if (input->data[start - 1] == '\n' && --lines == 0)
+            break;
+
+    buffer_add (expected, input->data + start, length - start);
+
+    //tail adds a newline if the file has none at the end
+    if (input->data[length - 1] != '\n')
+        buffer_addc (expected, '\n');
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* grep                                                                */
+/* ------------------------------------------------------------------ */
+
+/**
+ * Put a line of GREP_BINARY_CHECK (grep's buffer) 'z's, pattern
+ * and after in front of input
+ *
+ * The file starts with it, so its second piece starts at pattern
+ *
+ */
+void add_long_line (struct buffer *input, const char *pattern,
+                    const char *after)
+{
+    struct buffer line = { 0 };
+
+    for (int i = 0; i < GREP_BINARY_CHECK; i++)
+        buffer_addc (&line, 'z');
+
+    buffer_printf (&line, "%s%s\n", pattern, after);
+    buffer_add (&line, input->data, input->length);
+
+    free (input->data);
+    *input = line;
+}
+
+void setup_grep (struct buffer *input, char **args)
+{
+    int argc = 0;
+
+    make_text (input, GREP_LINE_MAX);
+
+    //The text has NULs in it, search it as text anyway
+    args[argc++] = "-a";
+
+    if (random_below (2))
+        args[argc++] = "-i";
+
+    if (random_below (4) == 0)
+        args[argc++] = "-w";
+
+    if (random_below (4) == 0)
+    {
+        args[argc++] = "-m";
+        args[argc] = make_arg (argc, "%lu", 1 + random_below (5));
+        argc++;
+    }
+
+    args[argc] = (char *) words[random_below (16)];
+
+  /** A line longer than grep's buffer, the pattern in its second piece */
+    // The piece starts with the pattern, but it's not a whole word
+    // and the piece is not a whole line. Only with -w and -x, without
+    // them the pattern is found and grep prints only the piece
+    if (find_arg (args, "-w", false) != NULL && random_below (3) == 0)
+        add_long_line (input, args[argc], random_below (2) ? "" : " -");
+
+  /** Whole lines, add some lines that are just the pattern */
+    if (random_below (6) == 0)
+    {
+        args[argc + 1] = args[argc];
+        args[argc++] = "-x";
+
+        for (int i = random_below (4); i > 0; i--)
+        {
+            buffer_add (input, args[argc], strlen (args[argc]));
+
+            if (random_below (2))
+                buffer_addc (input, '\r');
+
+            buffer_addc (input, '\n');
+        }
+
+        if (random_below (3) == 0)
+            add_long_line (input, args[argc], "");
+    }
+}
+
+/**
+ * grep -j N, with lines split over threads
+ *
+ */
+void setup_grep_jobs (struct buffer *input, char **args)
+{
+    setup_grep (input, args);
+    add_jobs (args);
+}
+
+/**
+ * grep -R, searching a packed file as it is
+ *
+ */
+void setup_grep_raw (struct buffer *input, char **args)
+{
+    setup_grep (input, args);
+    add_first (args, "-R");
+}
+
+/**
+ * Is ch part of a word, for grep -w?
+ *
+ */
+bool is_word_char (int ch)
+{
+    return isalnum (ch) || ch == '_';
+}
+
+int reference_grep (struct buffer *input, char **args,
+                    struct buffer *expected)
+{
+    bool insensitive = find_arg (args, "-i", false) != NULL;
+    bool whole_word = find_arg (args, "-w", false) != NULL;
+    bool whole_line = find_arg (args, "-x", false) != NULL;
+    char *max_arg = find_arg (args, "-m", true);
+    long max_count = max_arg != NULL ? atol (max_arg) : -1;
+    char *pattern = args[arg_count (args) - 1];
+    size_t pattern_length = strlen (pattern);
+    size_t start = 0;
+
+    while (start < input->length && max_count != 0)
+    {
+        //Find the end of the line
+        size_t end = start;
+
+        while (end < input->length && input->data[end] != '\n')
+            end++;
+
+        //Without the line ending, for -x
+        size_t content_end = end;
+
+        if (content_end > start && input->data[content_end - 1] == '\r')
+            content_end--;
+
+        if (end < input->length)
+            end++;
+
+        //Try every position in the line
+        for (size_t i = start; i + pattern_length <= end; i++)
+        {
+            size_t j;
+
+            //The line has to be just the pattern
+            if (whole_line && (i != start
+                               || content_end - start != pattern_length))
+                break;
+
+            //The pattern has to be a word of its own
+            if (whole_word
+                && ((i > start
+                     && is_word_char ((unsigned char) input->data[i - 1]))
+                    || (i + pattern_length < end
+                        && is_word_char ((unsigned char)
+                                         input->data[i + pattern_length]))))
+                continue;
+
+            for (j = 0; j < pattern_length; j++)
+            {
+                int a = (unsigned char) input->data[i + j];
+                int b = (unsigned char) pattern[j];
+
+                if (insensitive ? tolower (a) != tolower (b) : a != b)
+                    break;
+            }
+
+            if (j == pattern_length)
+            {
+                buffer_add (expected, input->data + start, end - start);
+
+                //A newline is added to the last line if it has none
+                if (input->data[end - 1] != '\n')
+                    buffer_addc (expected, '\n');
+
+                max_count--;
+                break;
+            }
+        }
+
+        start = end;
+    }
+
+    return 0;
+}
+
+/**
+ * grep without -a
+ *
+ * Files with a NUL near the start are binary
+ *
+ */
+void setup_grep_binary (struct buffer *input, char **args)
+{
+    setup_grep (input, args);
+
+    //Drop the -a
+    memmove (args, args + 1, (MAX_ARGS - 1) * sizeof (char *));
+}
+
+int reference_grep_binary (struct buffer *input, char **args,
+                           struct buffer *expected)
+{
+    size_t check = input->length < GREP_BINARY_CHECK ?
+        input->length : GREP_BINARY_CHECK;
+
+    reference_grep (input, args, expected);
+
+    //Binary files only get a message, if anything matched
+    if (check != 0 && memchr (input->data, '\0', check) != NULL
+        && expected->length != 0)
+    {
+        expected->length = 0;
+        buffer_printf (expected, "Binary file %s/input matches\n", folder);
+    }
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* wc                                                                  */
+/* ------------------------------------------------------------------ */
+
+void setup_wc (struct buffer *input, char **args)
+{
+    int argc = 0;
+
+    make_text (input, 0);
+
+    //Any combination of -l -w -c, or none
+    if (random_below (2))
+        args[argc++] = "-l";
+
+    if (random_below (2))
+        args[argc++] = "-w";
+
+    if (random_below (2))
+        args[argc++] = "-c";
+}
+
+/**
+ * wc -j N, with words and lines split over threads
+ *
+ */
+void setup_wc_jobs (struct buffer *input, char **args)
+{
+    setup_wc (input, args);
+    add_jobs (args);
+}
+
+int reference_wc (struct buffer *input, char **args,
+                  struct buffer *expected)
+{
+    long lines = 0;
+    long words = 0;
+    bool in_word = false;
+
+    for (size_t i = 0; i < input->length; i++)
+    {
+        int ch = (unsigned char) input->data[i];
+
+        //\r is ignored
+        if (ch == '\r')
+            continue;
+
+        //Whitespace ends words
+        if (isspace (ch))
+        {
+            in_word = false;
+
+            if (ch == '\n')
+                lines++;
+        }
+
+        //Printable characters start them
+        else if (isprint (ch) && !in_word)
+        {
+            in_word = true;
+            words++;
+        }
+
+        //Anything else is part of the word it is in, if any
+    }
+
+    //Without -l, -w or -c all three are shown
+    bool all = !find_arg (args, "-l", false) && !find_arg (args, "-w", false)
+        && !find_arg (args, "-c", false);
+
+    if (all || find_arg (args, "-l", false))
+        buffer_printf (expected, "  %ld", lines);
+
+    if (all || find_arg (args, "-w", false))
+        buffer_printf (expected, "  %ld", words);
+
+    if (all || find_arg (args, "-c", false))
+        buffer_printf (expected, "  %ld", (long) input->length);
+
+    buffer_addc (expected, '\n');
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* strings                                                             */
+/* ------------------------------------------------------------------ */
+
+void setup_strings (struct buffer *input, char **args)
+{
+    int argc = 0;
+
+    make_binary (input);
+
+    if (random_below (2))
+    {
+        args[argc++] = "-n";
+        args[argc++] = make_arg (1, "%lu", 1 + random_below (12));
+    }
+
+    if (random_below (2))
+    {
+        args[argc++] = "-t";
+        args[argc++] = random_below (2) ? "x" : "d";
+    }
+
+    //Any combination of encodings, several at a time find
+    // overlapping runs
+    if (random_below (4))
+    {
+        char encodings[5];
+        int count = 0;
+
+        while (count == 0)
+            for (const char *enc = "sSlb"; *enc; enc++)
+                if (random_below (2))
+                    encodings[count++] = *enc;
+
+        encodings[count] = '\0';
+
+        args[argc++] = "-e";
+        args[argc++] = make_arg (2, "%s", encodings);
+    }
+
+    if (random_below (2))
+        args[argc++] = "-f";
+
+    //A pattern of one or two characters, found in many short runs
+    // and late in some long ones. Not starting with - so it isn't
+    // taken for an option
+    if (random_below (3) == 0)
+    {
+        char pattern[3];
+
+        pattern[0] = 'A' + random_below (58);
+        pattern[1] = 32 + random_below (95);
+        pattern[random_below (2) + 1] = '\0';
+
+        args[argc++] = "-m";
+        args[argc++] = make_arg (4, "%s", pattern);
+    }
+
+    //Sometimes another file first, scanned by the same trackers
+    if (random_below (3) == 0)
+    {
+        first_input.length = 0;
+        make_binary (&first_input);
+
+        args[argc++] = make_arg (3, "%s/first", folder);
+        write_file (args[argc - 1], &first_input);
+    }
+}
+
+/**
+ * strings -R, looking at a packed file as it is
+ *
+ */
+void setup_strings_raw (struct buffer *input, char **args)
+{
+    setup_strings (input, args);
+    add_first (args, "-R");
+}
+
+/**
+ * A run in one encoding (and phase), found by the reference
+ *
+ * strings looks for all encodings in one go and prints a run in
+ * pieces as its buffer fills up, so the reference has to know which
+ * runs are being printed at the same time
+ */
+struct strings_run
+{
+    char encoding;
+    int phase;
+
+    //Characters of the run, and how many have been printed
+    struct buffer text;
+    size_t printed;
+
+    //Offset of the first character
+    size_t start;
+
+    //Size of strings' buffer for it, doubled while a run that doesn't
+    // match -m yet fills it
+    size_t size;
+
+    //Is a line of this run waiting for more?
+    bool open;
+};
+
+struct strings_run strings_runs[5];
+int strings_run_count;
+
+//Run with a line waiting for more, -1 for none
+int strings_owner;
+
+//-t radix, or NULL
+char *strings_radix;
+
+//File being scanned with -f, or NULL
+char *strings_name;
+
+//-m pattern, or NULL
+char *strings_pattern;
+
+/**
+ * Does the run so far have the pattern in it (or is there none)?
+ *
+ */
+bool strings_matches (struct strings_run *run)
+{
+    size_t length;
+
+    if (strings_pattern == NULL)
+        return true;
+
+    length = strlen (strings_pattern);
+
+    for (size_t i = 0; i + length <= run->text.length; i++)
+        if (memcmp (run->text.data + i, strings_pattern, length) == 0)
+            return true;
+
+    return false;
+}
+
+/**
+ * Print what hasn't been printed of a run, and if complete end its line
+ *
+ * A line waiting for more from another run is ended first, the rest
+ * of that run goes on a line of its own. So does the rest of this run
+ * if its line was ended like that.
+ *
+ */
+void strings_print (int i, bool complete, struct buffer *expected)
+{
+    struct strings_run *run = &strings_runs[i];
+    size_t width = run->encoding == 'l' || run->encoding == 'b' ? 2 : 1;
+
+    if (strings_owner != -1 && strings_owner != i)
+    {
+        buffer_addc (expected, '\n');
+        strings_runs[strings_owner].open = false;
+    }
+
+    if (!run->open && strings_name)
+        buffer_printf (expected, "%s: ", strings_name);
+
+    if (!run->open && strings_radix)
+        buffer_printf (expected, *strings_radix == 'x' ? "%7lx " : "%7ld ",
+                       (long) (run->start + run->printed * width));
+
+    if (run->printed < run->text.length)
+        buffer_add (expected, run->text.data + run->printed,
+                    run->text.length - run->printed);
+
+    run->printed = run->text.length;
+    run->open = !complete;
+    strings_owner = complete ? -1 : i;
+
+    if (complete)
+        buffer_addc (expected, '\n');
+}
+
+/**
+ * A character that isn't printable (or the end of the file) ends a run
+ *
+ * Nothing is left to print if all of it has been printed and its
+ * line was ended by another run
+ *
+ */
+void strings_end (int i, size_t min_length, struct buffer *expected)
+{
+    struct strings_run *run = &strings_runs[i];
+
+    if (run->text.length >= min_length && strings_matches (run)
+        && (run->printed < run->text.length || run->open))
+        strings_print (i, true, expected);
+
+    run->text.length = 0;
+    run->printed = 0;
+}
+
+/**
+ * Print the runs in one file
+ *
+ */
+void strings_file (struct buffer *input, size_t min_length,
+                   struct buffer *expected)
+{
+
+  /** Every byte, for every encoding */
+    for (size_t at = 0; at < input->length; at++)
+    {
+        for (int i = 0; i < strings_run_count; i++)
+        {
+            struct strings_run *run = &strings_runs[i];
+            int ch = (unsigned char) input->data[at];
+            size_t offset = at;
+            bool printable;
+
+            if (run->encoding == 's' || run->encoding == 'S')
+                printable = (ch > 31 && ch < 128)
+                    || (run->encoding == 'S' && ch >= 160);
+            else
+            {
+                //Only at the second byte of a pair
+                if (at == 0 || ((at - 1) & 1) != (size_t) run->phase)
+                    continue;
+
+                int first = (unsigned char) input->data[at - 1];
+                int high = run->encoding == 'l' ? ch : first;
+
+                ch = run->encoding == 'l' ? first : ch;
+                offset = at - 1;
+                printable = high == 0 && ch > 31 && ch < 128;
+            }
+
+            if (!printable)
+            {
+                strings_end (i, min_length, expected);
+                continue;
+            }
+
+            if (run->text.length == 0)
+                run->start = offset;
+
+            buffer_addc (&run->text, ch);
+
+            //A full buffer is printed, or if the run has to match and
+            // doesn't yet, made twice as large
+            if (run->text.length - run->printed == run->size)
+            {
+                if (strings_matches (run))
+                    strings_print (i, false, expected);
+                else
+                    run->size *= 2;
+            }
+        }
+    }
+
+  /** The end of the file ends all runs */
+    for (int i = 0; i < strings_run_count; i++)
+        strings_end (i, min_length, expected);
+}
+
+int reference_strings (struct buffer *input, char **args,
+                       struct buffer *expected)
+{
+    char *length_arg = find_arg (args, "-n", true);
+    char *encodings = find_arg (args, "-e", true);
+    bool show_names = find_arg (args, "-f", false) != NULL;
+    size_t min_length = length_arg ? (size_t) atol (length_arg) : 4;
+    size_t buf_size = min_length > STRINGS_BUF_SIZE ? min_length
+        : STRINGS_BUF_SIZE;
+    char first_name[1024];
+    char name[1024];
+
+    strings_radix = find_arg (args, "-t", true);
+    strings_pattern = find_arg (args, "-m", true);
+    strings_owner = -1;
+    strings_run_count = 0;
+
+    if (encodings == NULL)
+        encodings = "s";
+
+  /** The encodings looked for */
+    // S finds all s finds, 16-bit strings start on even and odd offsets
+    if (strchr (encodings, 'S') || strchr (encodings, 's'))
+        strings_runs[strings_run_count++].encoding =
+            strchr (encodings, 'S') ? 'S' : 's';
+
+    for (const char *enc = "lb"; *enc; enc++)
+        for (int phase = 0; strchr (encodings, *enc) && phase < 2; phase++)
+        {
+            strings_runs[strings_run_count].encoding = *enc;
+            strings_runs[strings_run_count++].phase = phase;
+        }
+
+    for (int i = 0; i < strings_run_count; i++)
+    {
+        strings_runs[i].text = (struct buffer) { 0 };
+        strings_runs[i].printed = 0;
+        strings_runs[i].size = buf_size;
+        strings_runs[i].open = false;
+    }
+
+  /** The files, first_input if setup made one */
+    snprintf (first_name, sizeof (first_name), "%s/first", folder);
+    snprintf (name, sizeof (name), "%s/input", folder);
+
+    if (find_arg (args, first_name, false) != NULL)
+    {
+        strings_name = show_names ? first_name : NULL;
+        strings_file (&first_input, min_length, expected);
+    }
+
+    strings_name = show_names ? name : NULL;
+    strings_file (input, min_length, expected);
+
+    buffer_addc (expected, '\n');
+
+    for (int i = 0; i < strings_run_count; i++)
+        free (strings_runs[i].text.data);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* pack                                                                */
+/* ------------------------------------------------------------------ */
+
+/**
+ * pack -c, unpacked again with pack -d
+ *
+ * Text and binary data, sometimes repeated until it takes
+ * several 64KB blocks, with long matches across them
+ *
+ */
+void setup_pack (struct buffer *input, char **args)
+{
+    for (int i = random_below (4); i > 0; i--)
+        if (random_below (2))
+            make_text (input, 0);
+        else
+            make_binary (input);
+
+    if (input->length != 0 && random_below (4) == 0)
+    {
+        struct buffer once = { 0 };
+
+        buffer_add (&once, input->data, input->length);
+
+        while (input->length < 200000)
+            buffer_add (input, once.data, once.length);
+
+        free (once.data);
+    }
+
+    args[0] = "-c";
+}
+
+int reference_pack (struct buffer *input, char **args,
+                    struct buffer *expected)
+{
+    (void) args;
+
+    //What comes back is what went in
+    buffer_add (expected, input->data, input->length);
+
+    return 0;
+}
+
+/**
+ * Any utility on a packed file that was cut short
+ *
+ * It has to say so and fail, the file can't be read to the end.
+ * What it printed before it found out is not looked at.
+ *
+ */
+int reference_cut (struct buffer *input, char **args,
+                   struct buffer *expected)
+{
+    (void) input;
+    (void) args;
+    (void) expected;
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------ */
+/* echo                                                                */
+/* ------------------------------------------------------------------ */
+
+/**
+ * Pieces echo -e arguments are made from
+ *
+ */
+const char *echo_pieces[] = {
+    "abc", " ", "x", "\\\\", "\\a", "\\b", "\\e", "\\f", "\\n", "\\r",
+    "\\t", "\\v", "\\0", "\\01", "\\0101", "\\0777", "\\01234", "\\x4",
+    "\\x41", "\\xFF00", "\\xg", "\\c", "\\q", "\\", "0", "7", "f"
+};
+
+void setup_echo (struct buffer *input, char **args)
+{
+    int argc = 0;
+
+    (void) input;
+
+    if (random_below (2))
+        args[argc++] = "-n";
+
+    args[argc++] = "-e";
+
+  /** Arguments made of random pieces */
+    for (int i = random_below (4); i > 0; i--)
+    {
+        char *arg = arg_pool[argc];
+
+        //Can't start with -, echo would take it as an option
+        *arg = '\0';
+
+        for (int j = random_below (6); j > 0; j--)
+            if (strlen (arg) + 8 < sizeof (arg_pool[0]))
+                strcat (arg, echo_pieces[random_below (27)]);
+
+        args[argc++] = arg;
+    }
+}
+
+int reference_echo (struct buffer *input, char **args,
+                    struct buffer *expected)
+{
+    bool newline = find_arg (args, "-n", false) == NULL;
+    struct buffer joined = { 0 };
+    int first = newline ? 1 : 2;
+
+    (void) input;
+
+    //Nothing to print, not even a newline
+    if (args[first] == NULL)
+        return 0;
+
+  /** Join the arguments */
+    for (int i = first; args[i] != NULL; i++)
+    {
+        if (i != first)
+            buffer_addc (&joined, ' ');
+
+        buffer_add (&joined, args[i], strlen (args[i]));
+    }
+
+    buffer_addc (&joined, '\0');
+
+  /** Decode */
+    for (char *ch = joined.data; *ch; ch++)
+    {
+        if (*ch != '\\')
+        {
+            buffer_addc (expected, *ch);
+            continue;
+        }
+
+        ch++;
+
+        const char *plain = strchr ("\\abefnrtv", *ch);
+
+        if (*ch != '\0' && plain != NULL)
+        {
+            buffer_addc (expected, "\\\a\b\033\f\n\r\t\v"[plain - "\\abefnrtv"]);
+        }
+        else if (*ch == 'c')
+        {
+            //Nothing more, not even the newline
+            newline = false;
+            break;
+        }
+        else if (*ch == '0' || *ch == 'x')
+        {
+            int base = *ch == 'x' ? 16 : 8;
+            int max = *ch == 'x' ? 2 : 3;
+            int value = 0;
+            int digits = 0;
+
+            while (digits < max && ch[1] != '\0'
+                   && strchr (base == 16 ? "0123456789abcdefABCDEF" :
+                              "01234567", ch[1]))
+            {
+                ch++;
+                value = value * base + (isdigit (*ch) ? *ch - '0' :
+                                        tolower (*ch) - 'a' + 10);
+                digits++;
+            }
+
+            //\x needs a digit
+            if (base == 16 && digits == 0)
+            {
+                expected->length = 0;
+                free (joined.data);
+                return 1;
+            }
+
+            buffer_addc (expected, value);
+        }
+        else
+        {
+            //Invalid escape, nothing is printed
+            expected->length = 0;
+            free (joined.data);
+            return 1;
+        }
+    }
+
+    if (newline)
+        buffer_addc (expected, '\n');
+
+    free (joined.data);
+
+    return 0;
+}
+
+/**
+ * Byte lists for echo -x
+ *
+ * The expected bytes are worked out while the arguments are made
+ *
+ */
+struct buffer echo_x_bytes;
+int echo_x_status;
+
+void setup_echo_x (struct buffer *input, char **args)
+{
+    int argc = 0;
+
+    (void) input;
+
+    echo_x_bytes.length = 0;
+    echo_x_status = 0;
+
+    args[argc++] = "-x";
+
+    for (int i = 1 + random_below (8); i > 0; i--)
+    {
+        char *arg = arg_pool[argc];
+        int length = 0;
+
+        for (int j = 1 + random_below (4); j > 0; j--)
+        {
+            unsigned long value = random_below (300);
+            bool word = random_below (4) == 0;
+
+            if (word)
+                value = random_below (70000);
+
+          /** Write it in a random way */
+            switch (random_below (4))
+            {
+            case 0:
+                length += sprintf (arg + length, "%lu", value);
+                break;
+            case 1:
+                length += sprintf (arg + length, "&%lX", value);
+                break;
+            case 2:
+                length += sprintf (arg + length, "0x%lx", value);
+                break;
+            default:
+                //Not a number
+                length += sprintf (arg + length, "%luq", value);
+                echo_x_status = 1;
+                break;
+            }
+
+            if (word)
+                arg[length++] = ';';
+
+            arg[length++] = ',';
+            arg[length] = '\0';
+
+          /** Does it fit? */
+            if (value > (word ? 0xFFFF : 0xFF))
+                echo_x_status = 1;
+
+            buffer_addc (&echo_x_bytes, value & 0xFF);
+
+            if (word)
+                buffer_addc (&echo_x_bytes, value >> 8);
+        }
+
+        args[argc++] = arg;
+    }
+}
+
+int reference_echo_x (struct buffer *input, char **args,
+                      struct buffer *expected)
+{
+    (void) input;
+    (void) args;
+
+    //Nothing is printed if any value is bad
+    if (echo_x_status == 0)
+        buffer_add (expected, echo_x_bytes.data, echo_x_bytes.length);
+
+    return echo_x_status;
+}
+
+/* ------------------------------------------------------------------ */
+/* keyb                                                                */
+/* ------------------------------------------------------------------ */
+
+/**
+ * keyb's layouts, by number
+ *
+ */
+const char *layout_names[] = {
+    "UK", "US", "DE", "IT", "ES", "FR", "BE", "NO", "JP", "USI", "USA",
+    "CHD", "CHF", "DK", "SV", "PT", "BR", "DV"
+};
+
+/**
+ * VDU bytes keyb should send
+ *
+ * Worked out while the arguments are made, like for echo -x
+ *
+ */
+struct buffer keyb_bytes;
+int keyb_status;
+int keyb_layout;
+
+void setup_keyb (struct buffer *input, char **args)
+{
+    int argc = 0;
+    bool layout = random_below (4) != 0;
+    bool control = !layout || random_below (2);
+
+    (void) input;
+
+    keyb_bytes.length = 0;
+    keyb_status = 0;
+    keyb_layout = -1;
+
+  /** -k delay,rate,leds, sometimes out of range */
+    // Before or after the layout, the bytes are sent in that order
+    bool control_first = random_below (2);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (control && (pass == 0) == control_first)
+        {
+            unsigned long delay = random_below (10) == 0 ?
+                random_below (1200) : 250 + random_below (751);
+            unsigned long rate = random_below (10) == 0 ?
+                random_below (600) : 33 + random_below (468);
+            unsigned long leds = random_below (256);
+
+            args[argc++] = "-k";
+            args[argc] = make_arg (argc, "%lu,%lu,%lu", delay, rate, leds);
+            argc++;
+
+            if (delay < 250 || delay > 1000 || rate < 33 || rate > 500)
+                keyb_status = 1;
+
+            buffer_add (&keyb_bytes, "\027\000\210", 3);
+            buffer_addc (&keyb_bytes, delay & 0xFF);
+            buffer_addc (&keyb_bytes, delay >> 8);
+            buffer_addc (&keyb_bytes, rate & 0xFF);
+            buffer_addc (&keyb_bytes, rate >> 8);
+            buffer_addc (&keyb_bytes, leds);
+        }
+
+      /** The layout, by name or by number */
+        if (layout && (pass == 0) != control_first)
+        {
+            keyb_layout = random_below (18);
+
+            args[argc] = random_below (2) ?
+                (char *) layout_names[keyb_layout] :
+                make_arg (argc, "%d", keyb_layout);
+            argc++;
+
+            buffer_add (&keyb_bytes, "\027\000\201", 3);
+            buffer_addc (&keyb_bytes, keyb_layout);
+        }
+    }
+}
+
+int reference_keyb (struct buffer *input, char **args,
+                    struct buffer *expected)
+{
+    (void) input;
+    (void) args;
+
+    //Nothing is sent if -k is out of range
+    if (keyb_status != 0)
+        return keyb_status;
+
+    buffer_add (expected, keyb_bytes.data, keyb_bytes.length);
+
+    if (keyb_layout != -1)
+        buffer_printf (expected, "\nLayout set: %s\n",
+                       layout_names[keyb_layout]);
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Running                                                             */
+/* ------------------------------------------------------------------ */
+
+/**
+ * All tests
+ *
+ */
+const struct test_case tests[] = {
+    {"head", "head", INPUT_FILE, setup_head, reference_head, "head"},
+    {"head_I", "head", INPUT_FILE_TWICE, setup_head_index, reference_head,
+     NULL},
+    {"tail", "tail", INPUT_FILE, setup_tail, reference_tail, NULL},
+    {"tail_r", "tail", INPUT_FILE, setup_tail_reversed, reference_tail,
+     NULL},
+    {"tail_I", "tail", INPUT_FILE_TWICE, setup_tail_index, reference_tail,
+     NULL},
+    {"grep", "grep", INPUT_FILE, setup_grep, reference_grep, "grep"},
+    {"grep_bin", "grep", INPUT_FILE, setup_grep_binary,
+     reference_grep_binary, NULL},
+    {"grep_j", "grep", INPUT_FILE, setup_grep_jobs, reference_grep, NULL},
+    {"wc", "wc", INPUT_FILE, setup_wc, reference_wc, NULL},
+    {"wc_j", "wc", INPUT_FILE, setup_wc_jobs, reference_wc, NULL},
+    {"strings", "strings", INPUT_FILE, setup_strings, reference_strings,
+     NULL},
+    {"pack", "pack", INPUT_FILE_UNPACK, setup_pack, reference_pack, NULL},
+    {"echo", "echo", NO_INPUT, setup_echo, reference_echo, NULL},
+    {"echo_x", "echo", NO_INPUT, setup_echo_x, reference_echo_x, NULL},
+    {"keyb", "keyb", NO_INPUT, setup_keyb, reference_keyb, NULL},
+    {"head_lz4", "head", INPUT_FILE_PACKED, setup_head, reference_head, NULL},
+    {"grep_lz4", "grep", INPUT_FILE_PACKED, setup_grep, reference_grep, NULL},
+    {"grep_R", "grep", INPUT_FILE_PACKED_RAW, setup_grep_raw, reference_grep,
+     NULL},
+    {"wc_lz4", "wc", INPUT_FILE_PACKED, setup_wc, reference_wc, NULL},
+    {"wc_cut", "wc", INPUT_FILE_PACKED_CUT, setup_wc, reference_cut, NULL},
+    {"strings_lz4", "strings", INPUT_FILE_PACKED, setup_strings,
+     reference_strings, NULL},
+    {"strings_R", "strings", INPUT_FILE_PACKED_RAW, setup_strings_raw,
+     reference_strings, NULL},
+};
+
+const int test_count = sizeof (tests) / sizeof (tests[0]);
+
+/**
+ * Run a program and collect what it prints
+ *
+ * Returns the exit status
+ *
+ */
+int run (char *path, char **argv, struct buffer *output)
+{
+    int pipe_ends[2];
+    pid_t child;
+    int status;
+
+    if (pipe (pipe_ends) != 0 || (child = fork ()) == -1)
+        exit_with_error ("Could not start utility");
+
+  /** In the child, run it */
+    if (child == 0)
+    {
+        int null = open ("/dev/null", O_RDWR);
+
+        dup2 (pipe_ends[1], STDOUT_FILENO);
+        dup2 (null, STDIN_FILENO);
+        dup2 (null, STDERR_FILENO);
+        close (pipe_ends[0]);
+        close (pipe_ends[1]);
+
+        //Same character classes as the utilities
+        setenv ("LC_ALL", "C", 1);
+
+        execvp (path, argv);
+        _exit (127);
+    }
+
+  /** In the parent, collect the output */
+    close (pipe_ends[1]);
+
+    char block[4096];
+    ssize_t got;
+
+    while ((got = read (pipe_ends[0], block, sizeof (block))) > 0)
+        buffer_add (output, block, got);
+
+    close (pipe_ends[0]);
+
+    if (waitpid (child, &status, 0) == -1 || !WIFEXITED (status))
+        return -1;
+
+    return WEXITSTATUS (status) == 0 ? 0 : 1;
+}
+
+/**
+ * Save a buffer in the test folder, named after the test and seed
+ *
+ */
+void save (const struct test_case *test, unsigned long seed, char *what,
+           struct buffer *buffer)
+{
+    char filename[1024];
+    FILE *file;
+
+    snprintf (filename, sizeof (filename), "%s/failed-%s-%lu.%s",
+              folder, test->name, seed, what);
+
+    if ((file = fopen (filename, "wb")) == NULL)
+        return;
+
+    if (buffer->length != 0)
+        fwrite (buffer->data, 1, buffer->length, file);
+
+    fclose (file);
+}
+
+/**
+ * Report a difference, and save the input for a closer look
+ *
+ */
+void report (const struct test_case *test, unsigned long seed,
+             char **argv, struct buffer *input, char *what,
+             struct buffer *expected, struct buffer *got)
+{
+    size_t at = 0;
+
+    while (at < expected->length && at < got->length
+           && expected->data[at] == got->data[at])
+        at++;
+
+    fprintf (stderr, "FAIL %s seed %lu: %s\n", test->name, seed, what);
+    fprintf (stderr, "  command:");
+
+    for (int i = 0; argv[i] != NULL; i++)
+        fprintf (stderr, " '%s'", argv[i]);
+
+    fprintf (stderr, "\n  expected %zu bytes, got %zu, first difference at %zu\n",
+             expected->length, got->length, at);
+    fprintf (stderr, "  input and outputs saved as %s/failed-%s-%lu.*\n",
+             folder, test->name, seed);
+
+  /** Save the input and both outputs */
+    if (test->input == INPUT_FILE_TWICE)
+        save (test, seed, "first", &first_input);
+
+    save (test, seed, "in", input);
+    save (test, seed, "expected", expected);
+    save (test, seed, "got", got);
+}
+
+/**
+ * Are two outputs the same?
+ *
+ * Empty buffers have no data at all, memcmp() isn't called for them
+ *
+ */
+bool same_output (struct buffer *a, struct buffer *b)
+{
+    return a->length == b->length
+        && (a->length == 0 || memcmp (a->data, b->data, a->length) == 0);
+}
+
+/**
+ * Pack input with pack -c into packed
+ *
+ */
+void pack_input (struct buffer *input, struct buffer *packed)
+{
+    char path[1024];
+    char filename[1024];
+    char *argv[] = { "pack", "-c", filename, NULL };
+
+    snprintf (path, sizeof (path), "%s/pack", build);
+    snprintf (filename, sizeof (filename), "%s/unpacked", folder);
+    write_file (filename, input);
+
+    if (run (path, argv, packed) != 0)
+        exit_with_error ("Could not pack the input");
+}
+
+/**
+ * Unpack output with pack -d, replacing it with what comes out
+ *
+ * Returns the exit status of pack
+ *
+ */
+int unpack_output (struct buffer *output)
+{
+    char path[1024];
+    char filename[1024];
+    char *argv[] = { "pack", "-d", "-c", filename, NULL };
+
+    snprintf (path, sizeof (path), "%s/pack", build);
+    snprintf (filename, sizeof (filename), "%s/output.lz4", folder);
+    write_file (filename, output);
+
+    output->length = 0;
+
+    return run (path, argv, output);
+}
+
+/**
+ * Run one test with one seed
+ *
+ * Returns true if it passed
+ *
+ */
+bool run_test (const struct test_case *test, unsigned long seed)
+{
+    struct buffer input = { 0 };
+    struct buffer expected = { 0 };
+    struct buffer got = { 0 };
+    char *args[MAX_ARGS] = { NULL };
+    char *argv[MAX_ARGS + 4];
+    char path[1024];
+    char filename[1024];
+    char index_name[1024];
+    int argc = 0;
+    bool passed = true;
+
+  /** Make the input and the arguments */
+    seed_random (seed);
+    test->setup (&input, args);
+
+    snprintf (path, sizeof (path), "%s/%s", build, test->tool);
+    snprintf (filename, sizeof (filename), "%s/input", folder);
+
+    argv[argc++] = test->tool;
+
+    for (int i = 0; args[i] != NULL; i++)
+        argv[argc++] = args[i];
+
+    if (test->input != NO_INPUT)
+        argv[argc++] = filename;
+
+    argv[argc] = NULL;
+
+  /** The first of two runs */
+    // Without the index of an earlier test
+    int expected_status = 0;
+    int status = 0;
+
+    if (test->input == INPUT_FILE_TWICE)
+    {
+        snprintf (index_name, sizeof (index_name), "%s/input.idx", folder);
+        remove (index_name);
+
+        write_file (filename, &first_input);
+        expected_status = test->reference (&first_input, args, &expected);
+        status = run (path, argv, &got);
+    }
+
+  /** Packed input */
+    // The reference looks at seen, the input or the packed bytes
+    struct buffer packed = { 0 };
+    struct buffer *seen = &input;
+
+    if (test->input == INPUT_FILE_PACKED
+        || test->input == INPUT_FILE_PACKED_RAW
+        || test->input == INPUT_FILE_PACKED_CUT)
+    {
+        pack_input (&input, &packed);
+
+        if (test->input == INPUT_FILE_PACKED_RAW)
+            seen = &packed;
+
+        if (test->input == INPUT_FILE_PACKED_CUT)
+            packed.length = 4 + random_below (packed.length - 4);
+
+        write_file (filename, &packed);
+    }
+    else if (test->input != NO_INPUT)
+        write_file (filename, &input);
+
+  /** Compare with the reference */
+    expected_status |= test->reference (seen, args, &expected);
+    status |= run (path, argv, &got);
+
+    //Only the failure counts, not what was printed before it
+    if (test->input == INPUT_FILE_PACKED_CUT)
+        got.length = 0;
+
+  /** Unpack what was packed */
+    if (test->input == INPUT_FILE_UNPACK && status == 0)
+        status = unpack_output (&got);
+
+    if (status != expected_status)
+    {
+        report (test, seed, argv, &input,
+                status ? "failed, the reference did not" :
+                "did not fail, the reference did", &expected, &got);
+        passed = false;
+    }
+    else if (!same_output (&expected, &got))
+    {
+        report (test, seed, argv, &input, "output differs from reference",
+                &expected, &got);
+        passed = false;
+    }
+
+  /** Compare with coreutils */
+    // Not grep -x, coreutils sees the \r of a \r\n as part of the line,
+    // and not head -r, coreutils has no such option
+    if (passed && use_coreutils && test->coreutils != NULL
+        && find_arg (args, "-x", false) == NULL
+        && find_arg (args, "-r", false) == NULL)
+    {
+        struct buffer coreutils = { 0 };
+
+        //grep needs to be told the pattern is not a regular expression,
+        // and that NULs don't make the input a binary file
+        if (strcmp (test->coreutils, "grep") == 0)
+        {
+            memmove (argv + 3, argv + 1, argc * sizeof (char *));
+            argv[1] = "-F";
+            argv[2] = "-a";
+        }
+
+        argv[0] = test->coreutils;
+        run (test->coreutils, argv, &coreutils);
+
+        if (!same_output (&coreutils, &got))
+        {
+            report (test, seed, argv, &input, "output differs from coreutils",
+                    &coreutils, &got);
+            passed = false;
+        }
+
+        free (coreutils.data);
+    }
+
+    if (!passed && packed.length != 0)
+        save (test, seed, "lz4", &packed);
+
+    free (input.data);
+    free (packed.data);
+    free (expected.data);
+    free (got.data);
+
+    return passed;
+}
+
+/**
+ * Helper function to print a help message
+ *
+ */
+void show_usage (char *prog_name)
+{
+    printf ("Usage: %s [-hu] [-n iterations] [-s seed] [-b build] [-c test]\n",
+            prog_name);
+    printf ("-h show this help message\n");
+    printf ("-n iterations per test (default: 200)\n");
+    printf ("-s first seed (default: 1)\n");
+    printf ("-b folder with the utilities (default: build)\n");
+    printf ("-c only run the test named test\n");
+    printf ("-u also compare head and grep with coreutils\n");
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned long iterations = 200;
+    unsigned long first_seed = 1;
+    char *only = NULL;
+    static char test_folder[1024];
+
+  /** Argument processing */
+    for (int i = 1; i != argc; i++)
+    {
+        if (strcmp (argv[i], "-h") == 0)
+        {
+            show_usage (argv[0]);
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp (argv[i], "-n") == 0 && i + 1 != argc)
+            iterations = strtoul (argv[++i], NULL, 10);
+        else if (strcmp (argv[i], "-s") == 0 && i + 1 != argc)
+            first_seed = strtoul (argv[++i], NULL, 10);
+        else if (strcmp (argv[i], "-b") == 0 && i + 1 != argc)
+            build = argv[++i];
+        else if (strcmp (argv[i], "-c") == 0 && i + 1 != argc)
+            only = argv[++i];
+        else if (strcmp (argv[i], "-u") == 0)
+            use_coreutils = true;
+        else
+        {
+            show_usage (argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+  /** Inputs and failures go in a folder of their own */
+    snprintf (test_folder, sizeof (test_folder), "%s/test", build);
+    folder = test_folder;
+    mkdir (folder, 0755);
+
+  /** Run them */
+    int failed = 0;
+
+    for (int i = 0; i < test_count; i++)
+    {
+        unsigned long passed = 0;
+
+        if (only != NULL && strcmp (tests[i].name, only) != 0)
+            continue;
+
+        for (unsigned long seed = first_seed;
+             seed < first_seed + iterations; seed++)
+            if (run_test (&tests[i], seed))
+                passed++;
+
+        printf ("%-11s %lu/%lu passed\n", tests[i].name, passed, iterations);
+
+        if (passed != iterations)
+            failed++;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
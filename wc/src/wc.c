@@ -15,148 +15,260 @@
 #include <ctype.h>
 #include <stdint.h>
 
+#include "blockio.h"
+#include "output.h"
+#include "parallel.h"
+#include "stats.h"
+
 /**
  * Helper funcion to print a help message
  *
  */
 void show_usage (char *prog_name)
 {
-    printf ("Usage: %s [-chlw] filename\r\n", prog_name);
+    printf ("Usage: %s [-chlwuS] filename\r\n", prog_name);
     printf ("-c print the characters count\r\n");
     printf ("-l print the lines count\r\n");
     printf ("-w print the words count\r\n");
+    printf ("-u print output at once, unbuffered\r\n");
     printf ("-h show this help message\r\n");
+    printf ("-S show I/O statistics\r\n");
+#ifdef HOST_BUILD
+    printf ("-j N count with N threads\r\n");
+#endif
 }
 
 /**
- * Count lines, words & characters from a stream
+ * Counts, and if a block ended inside a word
  *
  */
-void count(FILE *input, long *lines, long *words, long *chars) {
-  //Set the count to zero before we start
-  *lines = 0;
-  *words = 0;
-  *chars = 0;
-
-  //Storage to load into
-  //We make it 513, the 512th and last position have to have a non null valid value
-  // This is so we can tell if the 
-  
-  char storage[513];
-  char *end_of_storage = storage + 511;
-
-  //we start by pointing at the very last element
-  //this is used to trigger the loading of a new block
-  char *temp_pointer = end_of_storage + 1; 
-
-  //set the very last element to anything other than \0
-  *temp_pointer = ' '; 
-  
-  //Keep track of if we are in a word or not
-  //We start "outside" a word
-  int in_word = 0;
-  
-  
-  //Check every character in the buffer
-  while(*temp_pointer != '\0') {
-
-    //do we need to load a new block?
-    if(temp_pointer > end_of_storage) {
-      long chars_read = fread(storage, 1, 512, input);
-
-      //Check for empty read
-      if(chars_read == 0) 
-        if(feof(input)) //No more data
-	  break;        //Leave the while loop
-
-      
-
-      //we got a complete 512 block?
-      if(chars_read != 512) {
-	//error?
-	//this will also catch an empty read that is an error 
-	if(ferror(input)) {
-	  fprintf(stderr, "Error reading from file\n");
-	  exit(EXIT_FAILURE);
-	}
-
-	//nul terminate the string we did get
-	storage[chars_read] = '\0';
-      }
-
-      temp_pointer = storage;
-    }
+struct counts {
+  long lines;
+  long words;
+  long chars;
+  bool in_word;
+};
+
+/**
+ * Count lines, words & characters in a block
+ *
+ * Goes on from where the last block ended, counts->in_word tells if
+ * that was inside a word.
+ *
+ */
+void count_block(const char *block, size_t length, struct counts *counts) {
 
-    // Increment character count
-    // This can include control characters but wc's behaviour on unix(by posix standard)
-    // is to count them as well. Seems reasonable.
-    *chars += 1;
+  // Increment character count
+  // This can include control characters but wc's behaviour on unix(by posix standard)
+  // is to count them as well. Seems reasonable.
+  counts->chars += length;
+
+  //Check every character in the block
+  const unsigned char *temp_pointer = (const unsigned char *) block;
+  const unsigned char *end_of_block = temp_pointer + length;
+
+  for(; temp_pointer < end_of_block; temp_pointer++) {
 
-    
     //The dos style \r line ending screws things up, so we just ignore it
-    if(*temp_pointer == '\r') {
-      temp_pointer++;
-      continue; //Go back to the while loop and "continue"
-    }
-    
-    //check if we have a printable character
-    if(!isprint(*temp_pointer)) {
-      //nope, control char
-      //control characters are counted as part of a word if there other printable chars in the word
-      //and not if they appear on their own.
-      //
-      //
-      temp_pointer++;
-      continue;
-    }
+    if(*temp_pointer == '\r')
+      continue; //Go back to the for loop and "continue"
 
-    
     //Whitespace?
     if(isspace(*temp_pointer)) {
-      //Set inside of word marker to 0
-      in_word = 0;
+      //Not in a word any more
+      counts->in_word = false;
 
       //See if it was a newline
       if(*temp_pointer == '\n')
-	*lines += 1;
+        counts->lines += 1;
 
-      temp_pointer++;
+      continue;
+    }
+
+    //check if we have a printable character
+    if(!isprint(*temp_pointer)) {
+      //nope, control char
+      //control characters are counted as part of a word if there other printable chars in the word
+      //and not if they appear on their own.
       continue;
     }
 
     /* We have a non-whitespace printable character */
 
     //new word?
-    if(!in_word) {
+    if(!counts->in_word) {
       //Set the inside word marker and increment word count
-      in_word = 1;
-      *words += 1;
+      counts->in_word = true;
+      counts->words += 1;
     }
+  }
+}
+
+/**
+ * Count only lines & characters in a block, for -l and -c
+ *
+ * Words are not needed, so all there is to do is find the newlines,
+ * which memchr() does a lot faster than looking at every character.
+ *
+ */
+void count_lines_block(const char *block, size_t length, struct counts *counts) {
+  const char *end_of_block = block + length;
+  const char *newline;
+
+  counts->chars += length;
+
+  for(; (newline = memchr(block, '\n', end_of_block - block)) != NULL; block = newline + 1)
+    counts->lines += 1;
+}
+
+/**
+ * The counting loop to use
+ *
+ * Picked once in main(), count_lines_block() if the words are not shown
+ *
+ */
+void (*counter)(const char *block, size_t length, struct counts *counts) = count_block;
+
+/**
+ * Count lines, words & characters from a stream
+ *
+ * Returns why a compressed file ended early, NULL if it didn't
+ */
+const char *count(FILE *input, long *lines, long *words, long *chars) {
+  //Set the count to zero before we start
+  //We start "outside" a word
+  struct counts counts = { 0, 0, 0, false };
 
-    //All done, go to next char
-    temp_pointer++;
-    continue;
+  //Blocks are read by the block reader and looked at where they were read to
+  block_reader reader = block_reader_open(input, 0);
+  char *block;
+  size_t length;
+
+  //Go over the file one block at a time
+  while((length = block_reader_next(reader, &block)) != 0)
+    counter(block, length, &counts);
+
+  const char *error = block_reader_error(reader);
+
+  block_reader_close(reader);
+
+  *lines = counts.lines;
+  *words = counts.words;
+  *chars = counts.chars;
+
+  return error;
+}
+
+#ifdef HOST_BUILD
+/**
+ * Counts of one chunk, for -j
+ *
+ * Every chunk is counted as if it starts outside a word. When the
+ * chunk before it ended inside a word and this one starts with a
+ * word, that word was counted twice.
+ *
+ */
+struct chunk_counts {
+  struct counts counts;
+
+  //Is the first character that matters printable (so part of a word)?
+  bool starts_word;
+
+  //Is there any character that matters at all?
+  // \r and control characters don't start or end words
+  bool changes_word;
+};
+
+//Counts of the chunks merged so far
+struct counts totals;
+
+/**
+ * Count one chunk, on a thread of its own
+ *
+ */
+void count_chunk(const char *chunk, size_t length, void *result) {
+  struct chunk_counts *chunk_counts = result;
+
+  counter(chunk, length, &chunk_counts->counts);
+
+  //Find the first character that starts or ends a word
+  for(size_t i = 0; i < length; i++) {
+    unsigned char ch = chunk[i];
+
+    if(ch == '\r')
+      continue;
+
+    if(isspace(ch) || isprint(ch)) {
+      chunk_counts->changes_word = true;
+      chunk_counts->starts_word = !isspace(ch);
+      break;
+    }
   }
+}
 
+/**
+ * Add the counts of a chunk to the totals
+ *
+ */
+void merge_counts(void *result) {
+  struct chunk_counts *chunk_counts = result;
+
+  totals.lines += chunk_counts->counts.lines;
+  totals.words += chunk_counts->counts.words;
+  totals.chars += chunk_counts->counts.chars;
+
+  //A word going on from the last chunk
+  if(totals.in_word && chunk_counts->starts_word)
+    totals.words -= 1;
+
+  if(chunk_counts->changes_word)
+    totals.in_word = chunk_counts->counts.in_word;
 }
 
+/**
+ * Count lines, words & characters with jobs threads
+ *
+ * Returns false if the file can't be split into chunks
+ *
+ */
+bool count_parallel(FILE *input, int jobs, long *lines, long *words, long *chars) {
+  if(!parallel_scan(input, jobs, false, sizeof(struct chunk_counts),
+                    count_chunk, merge_counts))
+    return false;
+
+  *lines = totals.lines;
+  *words = totals.words;
+  *chars = totals.chars;
+
+  return true;
+}
+#endif
+
 /**
  * Show the counts requested by the user
  *
  */
 void show_counts (long lines, long words, long chars)
 {
-  if(lines >= 0)
-    printf("  %ld", lines);
+  block_writer out = output_console ();
+
+  if(lines >= 0) {
+    block_writer_write (out, "  ", 2);
+    output_number (out, lines, 10, 0);
+  }
 
-  if(words >= 0)
-    printf("  %ld", words);
+  if(words >= 0) {
+    block_writer_write (out, "  ", 2);
+    output_number (out, words, 10, 0);
+  }
 
-  if(chars >= 0)
-    printf("  %ld", chars);
+  if(chars >= 0) {
+    block_writer_write (out, "  ", 2);
+    output_number (out, chars, 10, 0);
+  }
 
-  printf("\n");
-      
+  output_char (out, '\n');
+  block_writer_close (out);
 }
 
 int main (int argc, char *argv[])
@@ -166,6 +278,9 @@ int main (int argc, char *argv[])
     bool show_lines = false;
     bool show_words = false;
     bool show_chars = false;
+#ifdef HOST_BUILD
+    int jobs = 1;
+#endif
 
     for (int i = 1; i != argc; i++)
     {
@@ -187,6 +302,20 @@ int main (int argc, char *argv[])
         {
             show_chars = true;
         }
+        else if (strcmp (argv[i], "-u") == 0)
+        {
+            output_unbuffered ();
+        }
+        else if (strcmp (argv[i], "-S") == 0)
+        {
+            stats_start ();
+        }
+#ifdef HOST_BUILD
+        else if (strcmp (argv[i], "-j") == 0 && i + 1 != argc)
+        {
+            jobs = atoi (argv[++i]);
+        }
+#endif
         else if (!filename)
         {
             filename = argv[i];
@@ -220,11 +349,26 @@ int main (int argc, char *argv[])
     long lines;
     long words;
     long chars;
+    const char *error = NULL;
 
     //Count lines, words and chars in file
-    //All are counted since it costs very little extra to do so
-    count(file, &lines, &words, &chars);
+    //Without words only the newlines have to be looked for,
+    // which is a lot quicker. Otherwise all are counted since
+    // it costs very little extra to do so
+    if(!show_words)
+      counter = count_lines_block;
+
+#ifdef HOST_BUILD
+    if(jobs <= 1 || !count_parallel(file, jobs, &lines, &words, &chars))
+#endif
+    error = count(file, &lines, &words, &chars);
     fclose (file);
+
+    //Counts of part of a compressed file would be wrong
+    if(error != NULL) {
+      fprintf(stderr, "%s: %s\n", filename, error);
+      return EXIT_FAILURE;
+    }
     
     if(!show_lines)
       lines = -1;
@@ -237,6 +381,7 @@ int main (int argc, char *argv[])
 
     // Display the counts
     show_counts (lines, words, chars);
+    stats_report ();
     
 
     return EXIT_SUCCESS;